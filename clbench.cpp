@@ -18,69 +18,432 @@
 * USA.                                                                         *
 \******************************************************************************/
 #include <CL/cl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
+#include <set>
+#include <regex>
+#include <sched.h>
 #include <fstream>
+#include <getopt.h>
 #include <sstream>
 #include <streambuf>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <unistd.h>
 #include <vector>
+#if defined(__SSE__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 using namespace std;
 
+// Vendor queries for the PCI location of a device.
+#ifndef CL_DEVICE_PCI_BUS_INFO_KHR
+#define CL_DEVICE_PCI_BUS_INFO_KHR 0x410F
+#endif
+#ifndef CL_DEVICE_PCI_BUS_ID_NV
+#define CL_DEVICE_PCI_BUS_ID_NV 0x4008
+#endif
+#ifndef CL_DEVICE_PCI_SLOT_ID_NV
+#define CL_DEVICE_PCI_SLOT_ID_NV 0x4009
+#endif
+
 const string CL_FILE_NAME("vectorops.cl");
+const string FLOPS_FILE_NAME("flops.cl");
+const string MEMORY_FILE_NAME("memory.cl");
+const string LOCAL_FILE_NAME("local.cl");
 const string HELP_FILE_NAME("help.txt");
+const string WORK_SIZE_FILE_NAME("work_sizes.txt");
+const vector<string> BENCHMARK_NAMES{"vector", "transfer", "flops", "width",
+                                     "tune", "occupancy", "concurrent",
+                                     "stream", "launch", "memory", "local",
+                                     "kernels", "options", "types",
+                                     "zerocopy", "soak", "queues",
+                                     "roofline", "host", "sweep"};
+// Back to back launches timed together by the launch benchmark.
+const unsigned LAUNCH_BATCH_SIZE = 1000;
+// Dependent loads per pointer chasing launch.
+const int CHASE_STEPS = 1 << 16;
+// Loads per work-item and barrier rounds of the local memory benchmark.
+const int LOCAL_REPEAT = 1 << 12;
+
+// Elements generated from one random engine. Chunks are seeded on their
+// own so they can be filled, and checked, in any order on any thread.
+const size_t DATA_CHUNK_SIZE = 1 << 20;
+
+// Allocator that leaves elements uninitialized, so that pages are first
+// touched by the threads that fill them rather than by resize().
+template<class T>
+struct default_init_allocator : allocator<T> {
+    template<class U>
+    struct rebind {
+        typedef default_init_allocator<U> other;
+    };
+
+    default_init_allocator() {}
+    template<class U>
+    default_init_allocator(const default_init_allocator<U>&) {}
+
+    template<class U>
+    void construct(U* ptr)
+    {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+    template<class U, class... Args>
+    void construct(U* ptr, Args&&... args)
+    {
+        ::new (static_cast<void*>(ptr)) U(forward<Args>(args)...);
+    }
+};
+
+// Host side benchmark data.
+typedef vector<float, default_init_allocator<float>> host_vector;
+
+// Leading elements of the host data, so devices given a smaller test size
+// than the largest one share its data without a copy. The data is
+// generated chunk by chunk, so a prefix verifies like data generated at
+// that size.
+class host_view {
+public:
+    typedef float value_type;
+
+    host_view(const host_vector& data)
+        : first(data.data()), count(data.size()) {}
+    host_view(const host_vector& data, size_t count)
+        : first(data.data()), count(min(count, data.size())) {}
+
+    const float* data() const { return first; }
+    size_t size() const { return count; }
+    const float& operator[](size_t i) const { return first[i]; }
+
+private:
+    const float* first;
+    size_t count;
+};
+
+default_random_engine chunk_generator(size_t chunk)
+{
+    seed_seq seed{static_cast<unsigned>(chunk),
+                  static_cast<unsigned>(chunk >> 32)};
+    return default_random_engine(seed);
+}
 
-// Initialize vec with size random values between min and max.
+// Pin the calling thread to cpus, if any are given.
+void pin_thread(const vector<unsigned>& cpus)
+{
+    if (cpus.empty())
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// Call func for every chunk index below chunks, spread over one thread
+// per cpu in cpus, or per core if none are given.
+void parallel_chunks(size_t chunks, const vector<unsigned>& cpus,
+                     const function<void(size_t)>& func)
+{
+    unsigned nthreads = cpus.empty() ? thread::hardware_concurrency() :
+        cpus.size();
+    nthreads = max(1u, min<unsigned>(nthreads, chunks));
+
+    vector<thread> threads;
+    for (unsigned t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&, t]() {
+            pin_thread(cpus);
+            for (size_t chunk = t; chunk < chunks; chunk += nthreads)
+                func(chunk);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+// Initialize vec with size random values between min and max. Chunks are
+// filled in parallel on cpus, if given, so memory is first touched on the
+// NUMA node of those cpus.
 template<class T>
 void initialize_data(T& vec, typename T::size_type size,
                      typename T::value_type min = 0,
-                     typename T::value_type max = 1)
+                     typename T::value_type max = 1,
+                     const vector<unsigned>& cpus = {})
 {
-    static default_random_engine gen;
-    uniform_real_distribution<typename T::value_type> dist(min, max);
     vec.resize(size);
-    for (auto& elem : vec)
-        elem = dist(gen);
+    size_t chunks = (size + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+    parallel_chunks(chunks, cpus, [&](size_t chunk) {
+        uniform_real_distribution<typename T::value_type> dist(min, max);
+        default_random_engine gen = chunk_generator(chunk);
+        size_t end = std::min(size, (chunk + 1) * DATA_CHUNK_SIZE);
+        for (size_t i = chunk * DATA_CHUNK_SIZE; i < end; ++i)
+            vec[i] = dist(gen);
+    });
 }
 
+// Outcome of checking device results against the host reference.
+struct verify_result {
+    size_t checked = 0;
+    size_t mismatched = 0;
+    double worst_ulp = 0;
+
+    bool passed() const
+    {
+        return checked && !mismatched;
+    }
+
+    void merge(const verify_result& other)
+    {
+        checked += other.checked;
+        mismatched += other.mismatched;
+        worst_ulp = max(worst_ulp, other.worst_ulp);
+    }
+};
 
-// Verify that the OpenCL device computes the square root correctly.
+// Error of value in units in the last place of reference.
 template<class T>
-bool verify_data(T& data, typename T::value_type min = 0,
-                 typename T::value_type max = 1)
+double ulp_error(T value, T reference)
 {
-    default_random_engine gen;
-    uniform_real_distribution<typename T::value_type> dist(min, max);
-    for (auto& elem : data) {
-        if (abs(elem * elem - dist(gen)) > 1.0E-6) {
-            return false;
-        }
+    if (value == reference)
+        return 0;
+    if (isnan(value) || isnan(reference))
+        return numeric_limits<double>::infinity();
+    T magnitude = fabs(reference);
+    T spacing = nextafter(magnitude, numeric_limits<T>::infinity()) -
+        magnitude;
+    return fabs(static_cast<double>(value) - reference) / spacing;
+}
+
+// Host reference of an element-wise kernel.
+typedef double (*reference_function)(double);
+
+double sqrt_reference(double x)
+{
+    return sqrt(x);
+}
+
+// Verify that the OpenCL device computes reference, by default the square
+// root, correctly. result holds count elements of chunk chunk of a buffer
+// filled by initialize_data; every element whose buffer index is a
+// multiple of stride is checked.
+template<class T>
+verify_result verify_data(const T* result, size_t chunk, size_t count,
+                          size_t stride, double max_ulp, T min = 0, T max = 1,
+                          reference_function reference = sqrt_reference)
+{
+    uniform_real_distribution<T> dist(min, max);
+    default_random_engine gen = chunk_generator(chunk);
+    size_t first = chunk * DATA_CHUNK_SIZE;
+    verify_result verified;
+    for (size_t i = 0; i < count; ++i) {
+        T input = dist(gen);
+        if ((first + i) % stride)
+            continue;
+        T expected = reference(input);
+        double error = ulp_error(result[i], expected);
+        ++verified.checked;
+        verified.worst_ulp = std::max(verified.worst_ulp, error);
+        if (!(error <= max_ulp))
+            ++verified.mismatched;
     }
-    return true;
+    return verified;
 }
 
 // Print all available OpenCL devices.
-void list_devices(vector<cl::Platform>& platforms, vector<cl::Device>& devices)
+void list_devices(vector<cl::Device>& devices)
 {
-    auto it = platforms.begin();
     cl_platform_id id = 0;
     for (unsigned i = 0; i < devices.size(); ++i) {
         auto cur = devices.at(i).getInfo<CL_DEVICE_PLATFORM>();
         if (cur != id) {
             id = cur;
-            cout << it++->getInfo<CL_PLATFORM_VENDOR>() << " "
-                 << it->getInfo<CL_PLATFORM_NAME>() << ":" << endl;
+            cl::Platform platform(cur);
+            cout << platform.getInfo<CL_PLATFORM_VENDOR>() << " "
+                 << platform.getInfo<CL_PLATFORM_NAME>() << ":" << endl;
         }
         cout << "[" << i << "] " <<
             devices.at(i).getInfo<CL_DEVICE_NAME>() << endl;
     }
 }
 
+// Which devices to enumerate: platforms whose name contains platform,
+// devices of type whose name matches name_pattern.
+struct device_filter {
+    string platform;
+    cl_device_type type = CL_DEVICE_TYPE_ALL;
+    string name_pattern;
+};
+
+// Devices passing filter, in platform order. Platforms that do not match
+// are never asked for their devices, so their drivers stay idle. Returns
+// false if there is no platform at all.
+bool find_devices(const device_filter& filter, vector<cl::Device>& devices)
+{
+    vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+    if (platforms.empty())
+        return false;
+    regex pattern(filter.name_pattern);
+    for (auto& platform : platforms) {
+        if (platform.getInfo<CL_PLATFORM_NAME>().find(filter.platform) ==
+            string::npos)
+            continue;
+        vector<cl::Device> found;
+        platform.getDevices(filter.type, &found);
+        for (auto& device : found)
+            if (regex_search(device.getInfo<CL_DEVICE_NAME>(), pattern))
+                devices.push_back(device);
+    }
+    return true;
+}
+
+// PCI address of device as used in /sys/bus/pci/devices, or an empty
+// string when no vendor extension reports it.
+string device_pci_address(const cl::Device& device)
+{
+    cl_uint domain = 0, bus, dev, function;
+    string extensions = device.getInfo<CL_DEVICE_EXTENSIONS>();
+    if (extensions.find("cl_khr_pci_bus_info") != string::npos) {
+        cl_uint info[4];
+        if (clGetDeviceInfo(device(), CL_DEVICE_PCI_BUS_INFO_KHR,
+                            sizeof(info), info, NULL) != CL_SUCCESS)
+            return "";
+        domain = info[0];
+        bus = info[1];
+        dev = info[2];
+        function = info[3];
+    } else if (extensions.find("cl_nv_device_attribute_query") !=
+               string::npos) {
+        cl_uint slot;
+        if (clGetDeviceInfo(device(), CL_DEVICE_PCI_BUS_ID_NV, sizeof(bus),
+                            &bus, NULL) != CL_SUCCESS ||
+            clGetDeviceInfo(device(), CL_DEVICE_PCI_SLOT_ID_NV, sizeof(slot),
+                            &slot, NULL) != CL_SUCCESS)
+            return "";
+        dev = slot >> 3;
+        function = slot & 7;
+    } else {
+        return "";
+    }
+    stringstream ss;
+    ss << hex << setfill('0') << setw(4) << domain << ":" << setw(2) << bus
+       << ":" << setw(2) << dev << "." << function;
+    return ss.str();
+}
+
+// NUMA node closest to device, or -1 if unknown.
+int device_numa_node(cl::Device& device)
+{
+    string address = device_pci_address(device);
+    if (address.empty())
+        return -1;
+    ifstream file("/sys/bus/pci/devices/" + address + "/numa_node");
+    int node = -1;
+    file >> node;
+    return node;
+}
+
+// CPUs of a NUMA node, parsed from a sysfs list such as "0-7,16-23".
+vector<unsigned> numa_node_cpus(int node)
+{
+    vector<unsigned> cpus;
+    ifstream file("/sys/devices/system/node/node" + to_string(node) +
+                  "/cpulist");
+    string range;
+    while (getline(file, range, ',')) {
+        unsigned first = 0, last = 0;
+        char dash = 0;
+        stringstream ss(range);
+        ss >> first >> dash >> last;
+        if (dash != '-')
+            last = first;
+        for (unsigned cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Device temperature in degrees Celsius and clock in MHz, NaN where not
+// exposed.
+struct sensor_reading {
+    double temperature;
+    double clock_mhz;
+};
+
+// Value of a sysfs file times scale, or NaN.
+double read_sysfs_value(const string& path, double scale)
+{
+    ifstream file(path);
+    double value;
+    if (!(file >> value))
+        return numeric_limits<double>::quiet_NaN();
+    return value * scale;
+}
+
+// Files holding the temperature and clock of device. OpenCL has no query
+// for either, so GPUs use the hwmon directory of their PCI device, which
+// amdgpu and other DRM drivers fill, and CPUs the first CPU's cpufreq and
+// the first thermal zone.
+pair<string, string> sensor_files(cl::Device& device)
+{
+    if (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)
+        return {"/sys/class/thermal/thermal_zone0/temp",
+                "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"};
+    string address = device_pci_address(device);
+    if (address.empty())
+        return {"", ""};
+    string dir = "/sys/bus/pci/devices/" + address + "/hwmon/";
+    DIR* hwmon = opendir(dir.c_str());
+    if (!hwmon)
+        return {"", ""};
+    string name;
+    while (struct dirent* entry = readdir(hwmon)) {
+        if (string(entry->d_name).compare(0, 5, "hwmon") == 0) {
+            name = entry->d_name;
+            break;
+        }
+    }
+    closedir(hwmon);
+    if (name.empty())
+        return {"", ""};
+    return {dir + name + "/temp1_input", dir + name + "/freq1_input"};
+}
+
+sensor_reading read_sensors(cl::Device& device,
+                            const pair<string, string>& files)
+{
+    bool cpu = device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU;
+    return {read_sysfs_value(files.first, 1.0E-3),
+            read_sysfs_value(files.second, cpu ? 1.0E-3 : 1.0E-6)};
+}
+
 void print_help()
 {
     ifstream help(HELP_FILE_NAME);
@@ -88,17 +451,32 @@ void print_help()
                    istreambuf_iterator<char>());
 }
 
-// Parse command line input for memory size.
-void set_memory_test_size(const string& size, long unsigned& memory_test_size)
+// Parse command line input for memory size. A percentage, or "auto" for
+// 50%, sets memory_fraction to size the test data per device instead.
+void set_memory_test_size(const string& size, long unsigned& memory_test_size,
+                          double& memory_fraction)
 {
     stringstream ss(size);
     string prefix;
+    memory_fraction = 0;
+    if (size == "auto") {
+        memory_fraction = 0.5;
+        return;
+    }
     ss >> memory_test_size;
     ss >> prefix;
-    if (prefix == "M" || prefix == "m") {
+    if (prefix == "K" || prefix == "k") {
+        memory_test_size *= 1E3;
+    } else if (prefix == "M" || prefix == "m") {
         memory_test_size *= 1E6;
     } else if (prefix == "G" || prefix == "g") {
         memory_test_size *= 1E9;
+    } else if (prefix == "%") {
+        if (memory_test_size == 0 || memory_test_size > 100) {
+            cerr << "Memory percentage must be 1 to 100" << endl;
+            exit(1);
+        }
+        memory_fraction = memory_test_size / 100.0;
     } else if (prefix.size()) {
         cerr << "Unidentified size prefix \""
              << prefix << "\"" << endl;
@@ -106,145 +484,5003 @@ void set_memory_test_size(const string& size, long unsigned& memory_test_size)
     }
 }
 
-template <class T>
-void run_bench_function(cl::CommandQueue& queue, cl::Kernel& func, const T& data,
-                        const cl::Buffer& buff, size_t global_size, size_t local_size = 1)
+// Largest test size in bytes of a single buffer benchmark: the kernels
+// take the element count and index elements as int.
+const unsigned long MAX_TEST_SIZE =
+    static_cast<unsigned long>(INT_MAX) / 16 * 16 * sizeof(float);
+
+// Test size in bytes for device: memory_test_size, or memory_fraction of
+// the device's global memory when set. Unless uncapped, a fraction stays
+// within the largest single allocation, since every benchmark but stream
+// keeps the test data in one buffer, and any size within MAX_TEST_SIZE.
+unsigned long device_test_size(const cl::Device& device,
+                               unsigned long memory_test_size,
+                               double memory_fraction, bool uncapped = false)
 {
-    cl::NDRange global(global_size);
-    cl::NDRange local(local_size);
-    cl::Event event;
-    struct timeval tv1, tv2;
+    unsigned long size = memory_test_size;
+    if (memory_fraction != 0)
+        size = memory_fraction * device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+    if (uncapped)
+        return size;
+    if (memory_fraction != 0)
+        size = min<unsigned long>(
+            size, device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+    if (size > MAX_TEST_SIZE) {
+        cout << device.getInfo<CL_DEVICE_NAME>() << ": test size clamped "
+             << "from " << size / 1.0E6 << " MB to " << MAX_TEST_SIZE / 1.0E6
+             << " MB, the most elements an int can index" << endl;
+        size = MAX_TEST_SIZE;
+    }
+    return size;
+}
 
-    queue.enqueueWriteBuffer(buff, CL_TRUE, 0, sizeof(float) * data.size(),
-                             data.data());
+// Test data elements in size bytes, a multiple of the widest vector kernel.
+size_t test_elements(unsigned long size)
+{
+    return size / sizeof(float) / 16 * 16;
+}
 
-    gettimeofday(&tv1, NULL);
-    queue.enqueueNDRangeKernel(func, cl::NullRange,
-                               global, local, NULL, &event);
-    event.wait();
-    gettimeofday(&tv2, NULL);
-    double time = tv2.tv_sec - tv1.tv_sec +
-        (tv2.tv_usec - tv1.tv_usec) * 1.0E-6;
-
-    T verify(data.size() / 100);
-    queue.enqueueReadBuffer(buff, CL_TRUE, 0, sizeof(float) * verify.size(),
-                            verify.data());
-    if (!verify_data(verify)) {
-        cerr << "Invalid computation from device." << endl;
-        return;
-    }
+// Delta between two event profiling counters (nanoseconds), in seconds.
+double profiling_delta(cl_ulong from, cl_ulong to)
+{
+    return (to - from) * 1.0E-9;
+}
 
-    cout << data.size() / time / 1.0E6 << "M Elements Per Second" << endl;
+// Seconds between two host clock readings.
+double elapsed(const timeval& tv1, const timeval& tv2)
+{
+    return tv2.tv_sec - tv1.tv_sec + (tv2.tv_usec - tv1.tv_usec) * 1.0E-6;
 }
 
-// Compile and run benchmarking functions on OpenCL device.
-void run_vector_ops(cl::Device& device, const string& code, vector<float>& data)
+// Benchmark selection and trial loop settings shared by every benchmark.
+struct bench_options {
+    vector<string> benchmarks = {"vector"};
+    unsigned warmup = 1;
+    unsigned trials = 10;
+    double cv_threshold = 0;
+    unsigned mad_count = 1024;
+    size_t verify_stride = 1;
+    double max_ulp = 3;
+    // Set by -u, which then overrides the limits of descriptor kernels.
+    bool max_ulp_set = false;
+    long unsigned tile_size = 64E6;
+    unsigned stream_depth = 3;
+    string format = "text";
+    string baseline;
+    double regression_threshold = 0.05;
+    vector<vector<string>> build_axes;
+    double soak_seconds = 600;
+    string soak_kernel = "element_op";
+    unsigned queue_instances = 8;
+    string roofline_prefix;
+    unsigned long sweep_from = 4E3;
+    unsigned long sweep_to = 512E6;
+    double sweep_factor = 2;
+};
+
+bool benchmark_selected(const bench_options& options, const string& name)
 {
-    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
-    cl::Context context({device});
-    cl::Program::Sources source;
-    source.push_back({code.c_str(), code.length()});
-    cl::Program program(context, source);
-    if (program.build({device}) != CL_SUCCESS) {
-        cerr << "Error building. Verify OpenCL installation." << endl;
-        cout << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << endl;
+    return find(options.benchmarks.begin(), options.benchmarks.end(),
+                name) != options.benchmarks.end();
+}
+
+// Parse a <from>:<to>:x<factor> size sweep, e.g. 4K:16G:x2.
+void set_sweep(const string& sweep, bench_options& options)
+{
+    stringstream ss(sweep);
+    string from, to, factor;
+    getline(ss, from, ':');
+    getline(ss, to, ':');
+    getline(ss, factor);
+    double fraction_from, fraction_to;
+    set_memory_test_size(from, options.sweep_from, fraction_from);
+    set_memory_test_size(to, options.sweep_to, fraction_to);
+    if (factor.size() > 1 && factor[0] == 'x')
+        stringstream(factor.substr(1)) >> options.sweep_factor;
+    if (fraction_from != 0 || fraction_to != 0 || !options.sweep_from ||
+        options.sweep_to < options.sweep_from || factor.empty() ||
+        factor[0] != 'x' || !(options.sweep_factor > 1)) {
+        cerr << "Invalid sweep \"" << sweep
+             << "\", expected <from>:<to>:x<factor>" << endl;
         exit(1);
     }
-    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
-    cl::CommandQueue queue(context, device);
+}
 
-    // Run range based benchmark
-    cout << setw(15) << left << "Range Based:";
-    cl::Kernel range_op(program, "range_op");
-    range_op.setArg(0, buff);
-    int size = data.size();
-    range_op.setArg(1, size);
-    size_t nthreads = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
-    run_bench_function(queue, range_op, data, buff, nthreads);
+// Timing of a single kernel launch, in seconds.
+struct bench_timing {
+    double queued;
+    double submitted;
+    double kernel;
+    double wall;
+};
 
-    // Run element based benchmark
-    cout << setw(15) << "Element Based:";
-    cl::Kernel element_op(program, "element_op");
-    element_op.setArg(0, buff);
-    run_bench_function(queue, element_op, data, buff, data.size());
+// Summary of a set of samples.
+struct sample_stats {
+    double min;
+    double median;
+    double p95;
+    double max;
+    double mean;
+    double stddev;
+};
+
+// Value at fraction p of the sorted samples, using linear interpolation.
+double percentile(const vector<double>& sorted, double p)
+{
+    double pos = p * (sorted.size() - 1);
+    size_t lo = pos;
+    size_t hi = min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
 }
 
-int main(int argc, char* argv[])
+sample_stats compute_stats(vector<double> samples)
 {
-    vector<cl::Platform> platforms;
-    vector<cl::Device> devices;
-    unsigned long memory_test_size = 512E6;
-    bool device_index_set = false;
-    unsigned device_index = 0;
+    sample_stats stats;
+    sort(samples.begin(), samples.end());
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.median = percentile(samples, 0.5);
+    stats.p95 = percentile(samples, 0.95);
+    stats.mean = accumulate(samples.begin(), samples.end(), 0.0) /
+        samples.size();
+    double sq = 0;
+    for (auto sample : samples)
+        sq += (sample - stats.mean) * (sample - stats.mean);
+    stats.stddev = samples.size() > 1 ? sqrt(sq / (samples.size() - 1)) : 0;
+    return stats;
+}
 
-    // Find available OpenCL devices
-    cl::Platform::get(&platforms);
-    if (!platforms.size()) {
-        cerr << "No platforms found. Verify runtime installation." << endl;
-        exit(1);
+// Spans the tracer keeps; once full, the oldest are overwritten.
+const size_t TRACE_CAPACITY = 1 << 18;
+
+// One span of the trace: a host phase on a host thread, or a command on a
+// device queue. name is a string literal, so recording it allocates
+// nothing.
+struct trace_span {
+    const char* name;
+    cl_device_id device;
+    size_t lane;
+    double start;
+    double duration;
+};
+
+// Optional ring of trace spans. enable() allocates every slot up front, so
+// recording only overwrites one. Times are seconds since enable() on the
+// host clock.
+class tracer {
+public:
+    tracer() : next(0), active(false) {}
+
+    void enable()
+    {
+        spans.resize(TRACE_CAPACITY);
+        gettimeofday(&origin, NULL);
+        active = true;
     }
 
-    // Concatenate all platform devices into one device vector.
-    for (auto& platform: platforms) {
-        vector<cl::Device> tmp;
-        platform.getDevices(CL_DEVICE_TYPE_ALL, &tmp);
-        devices.insert(devices.end(), tmp.begin(), tmp.end());
+    bool enabled() const
+    {
+        return active;
     }
 
-    // Parse command line options
-    bool list_devices_flag = false;
-    int opt;
-    while ((opt = getopt(argc, argv, ":ls:h")) != -1) {
-        switch (opt) {
-        case 'l':
-            if (list_devices_flag)
+    double since(const timeval& tv) const
+    {
+        return elapsed(origin, tv);
+    }
+
+    double now() const
+    {
+        timeval tv;
+        gettimeofday(&tv, NULL);
+        return since(tv);
+    }
+
+    // device is NULL for host phases, lane the host thread or the queue.
+    void record(const char* name, cl_device_id device, size_t lane,
+                double start, double duration)
+    {
+        if (!active)
+            return;
+        size_t slot = next++ % spans.size();
+        spans[slot] = {name, device, lane, start, duration};
+    }
+
+    // Recorded spans, oldest first, and how many were overwritten.
+    vector<trace_span> recorded(size_t& dropped) const
+    {
+        size_t last = next;
+        size_t count = min(last, spans.size());
+        dropped = last - count;
+        vector<trace_span> found;
+        for (size_t i = last - count; i < last; ++i)
+            found.push_back(spans[i % spans.size()]);
+        return found;
+    }
+
+private:
+    vector<trace_span> spans;
+    atomic<size_t> next;
+    timeval origin;
+    bool active;
+};
+
+tracer trace;
+
+// Small index of the calling thread, its lane in the trace.
+size_t trace_thread()
+{
+    static atomic<size_t> threads(0);
+    thread_local size_t index = threads++;
+    return index;
+}
+
+// Record the enclosing scope as a host phase of the trace.
+class trace_scope {
+public:
+    explicit trace_scope(const char* name)
+        : name(name), start(trace.enabled() ? trace.now() : 0) {}
+
+    ~trace_scope()
+    {
+        if (trace.enabled())
+            trace.record(name, NULL, trace_thread(), start,
+                         trace.now() - start);
+    }
+
+private:
+    const char* name;
+    double start;
+};
+
+// Trace name of an OpenCL command type.
+const char* command_name(cl_command_type type)
+{
+    switch (type) {
+    case CL_COMMAND_NDRANGE_KERNEL:
+        return "kernel";
+    case CL_COMMAND_READ_BUFFER:
+        return "read buffer";
+    case CL_COMMAND_WRITE_BUFFER:
+        return "write buffer";
+    case CL_COMMAND_COPY_BUFFER:
+        return "copy buffer";
+    case CL_COMMAND_MAP_BUFFER:
+        return "map buffer";
+    case CL_COMMAND_UNMAP_MEM_OBJECT:
+        return "unmap";
+    default:
+        return "command";
+    }
+}
+
+// Record a completed, profiled event on its device's lane of the trace.
+// The device clock has its own origin, so the queued timestamp is taken
+// as the host reading tv1 made just before enqueueing.
+void trace_event(const cl::Event& event, const timeval& tv1, cl_ulong queued,
+                 cl_ulong start, cl_ulong end)
+{
+    cl_command_type type;
+    cl_command_queue queue;
+    cl_device_id device;
+    clGetEventInfo(event(), CL_EVENT_COMMAND_TYPE, sizeof(type), &type,
+                   NULL);
+    clGetEventInfo(event(), CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue,
+                   NULL);
+    clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(device), &device,
+                          NULL);
+    trace.record(command_name(type), device, reinterpret_cast<size_t>(queue),
+                 trace.since(tv1) + profiling_delta(queued, start),
+                 profiling_delta(start, end));
+}
+
+// Fill a timing record from a completed, profiled event and the host
+// clock readings taken around it.
+bench_timing event_timing(const cl::Event& event, const timeval& tv1,
+                          const timeval& tv2)
+{
+    // Device side timestamps exclude host scheduling and submit latency.
+    cl_ulong queued = event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+    cl_ulong submit = event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+    cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+    bench_timing timing;
+    timing.queued = profiling_delta(queued, submit);
+    timing.submitted = profiling_delta(submit, start);
+    timing.kernel = profiling_delta(start, end);
+    timing.wall = elapsed(tv1, tv2);
+    if (trace.enabled())
+        trace_event(event, tv1, queued, start, end);
+    return timing;
+}
+
+// Timing record for work timed on the host only.
+bench_timing host_timing(double seconds)
+{
+    bench_timing timing;
+    timing.queued = timing.submitted = 0;
+    timing.kernel = timing.wall = seconds;
+    return timing;
+}
+
+// Run warmup and measured calls of launch, stopping early once the kernel
+// times are stable enough.
+vector<bench_timing> collect_trials(const bench_options& options,
+                                    const function<bench_timing()>& launch)
+{
+    for (unsigned i = 0; i < options.warmup; ++i)
+        launch();
+
+    vector<bench_timing> timings;
+    vector<double> kernel;
+    for (unsigned i = 0; i < options.trials; ++i) {
+        timings.push_back(launch());
+        kernel.push_back(timings.back().kernel);
+        if (options.cv_threshold > 0 && kernel.size() >= 3) {
+            sample_stats stats = compute_stats(kernel);
+            if (stats.stddev / stats.mean < options.cv_threshold)
                 break;
-            list_devices_flag = true;
-            break;
-        case 's':
-            set_memory_test_size(optarg, memory_test_size);
-            break;
-        case 'h':
-            print_help();
-            exit(0);
-        default:
-            print_help();
-            exit(1);
         }
     }
+    return timings;
+}
 
-    if (list_devices_flag) {
-        list_devices(platforms, devices);
-        exit(0);
+// One field of every timing record, e.g. all kernel times.
+vector<double> timing_samples(const vector<bench_timing>& timings,
+                              double bench_timing::*field)
+{
+    vector<double> samples;
+    for (auto& timing : timings)
+        samples.push_back(timing.*field);
+    return samples;
+}
+
+// Device properties attached to every result record.
+struct device_info {
+    cl_device_id id;
+    string name;
+    string pci_address;
+    string vendor;
+    string driver;
+    string version;
+    cl_uint compute_units;
+    cl_uint clock_mhz;
+    cl_ulong global_mem;
+    cl_ulong max_alloc;
+    cl_ulong local_mem;
+};
+
+device_info describe_device(const cl::Device& device)
+{
+    device_info info;
+    info.id = device();
+    info.name = device.getInfo<CL_DEVICE_NAME>();
+    info.pci_address = device_pci_address(device);
+    info.vendor = device.getInfo<CL_DEVICE_VENDOR>();
+    info.driver = device.getInfo<CL_DRIVER_VERSION>();
+    info.version = device.getInfo<CL_DEVICE_VERSION>();
+    info.compute_units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    info.clock_mhz = device.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
+    info.global_mem = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+    info.max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+    info.local_mem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    return info;
+}
+
+// Trials of one configuration of one kernel. work is the amount done per
+// launch in unit, e.g. elements or bytes, so throughput is work / time.
+// verification is "passed", "failed" or empty when results are not
+// checked. flops and bytes per launch, where known, place the kernel on
+// the roofline.
+struct bench_record {
+    string benchmark;
+    string kernel;
+    string config;
+    double work;
+    string unit;
+    size_t global_size;
+    size_t local_size;
+    vector<bench_timing> timings;
+    string verification;
+    double flops;
+    double bytes;
+};
+
+// Named value of a result record, written unquoted when it is a number.
+struct record_field {
+    string name;
+    string value;
+    bool number;
+};
+
+template<class T>
+record_field number_field(const string& name, T value)
+{
+    stringstream ss;
+    if (isfinite(static_cast<double>(value)))
+        ss << setprecision(12) << value;
+    return {name, ss.str(), true};
+}
+
+// Text as a quoted JSON string.
+string json_string(const string& text)
+{
+    stringstream ss;
+    ss << "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\')
+            ss << '\\' << c;
+        else if (c < 0x20)
+            ss << "\\u" << hex << setw(4) << setfill('0')
+               << static_cast<int>(c) << dec;
+        else
+            ss << c;
     }
+    ss << "\"";
+    return ss.str();
+}
 
-    if (optind < argc) {
-        device_index_set = true;
-        stringstream(argv[optind]) >> device_index;
-        if (device_index >= devices.size()) {
-            cerr << "No device " << device_index << " found." << endl;
-            exit(1);
+// One trial of a result record, by field name.
+typedef map<string, string> record_row;
+
+// Records collected for machine readable output. Benchmarks running on
+// several threads may add records at the same time.
+class result_log {
+public:
+    // Store record for device and return its median kernel time.
+    double add(const cl::Device& device, const bench_record& record)
+    {
+        lock_guard<mutex> lock(mtx);
+        records.push_back({describe_device(device), record});
+        return compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel)).median;
+    }
+
+    // One record per trial as a JSON array.
+    void write_json(ostream& out) const
+    {
+        lock_guard<mutex> lock(mtx);
+        out << "[";
+        const char* separator = "\n";
+        for (auto& entry : records) {
+            for (unsigned i = 0; i < entry.second.timings.size(); ++i) {
+                out << separator << "  {";
+                const char* field_separator = "";
+                for (auto& field : fields(entry.first, entry.second, i)) {
+                    out << field_separator << "\"" << field.name << "\": ";
+                    if (!field.number)
+                        out << json_string(field.value);
+                    else if (field.value.empty())
+                        out << "null";
+                    else
+                        out << field.value;
+                    field_separator = ", ";
+                }
+                out << "}";
+                separator = ",\n";
+            }
         }
+        out << "\n]" << endl;
     }
 
-    // Read CL source file
-    ifstream source_file(CL_FILE_NAME);
-    if (!source_file.is_open()) {
-        cerr << "Error opening " << CL_FILE_NAME << " for reading "<< endl;
-        exit(1);
+    // Store record for a device that is not an OpenCL device, such as the
+    // host.
+    double add(const device_info& device, const bench_record& record)
+    {
+        lock_guard<mutex> lock(mtx);
+        records.push_back({device, record});
+        return compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel)).median;
     }
-    string code((istreambuf_iterator<char>(source_file)),
-                istreambuf_iterator<char>());
 
-    vector<float> data;
-    initialize_data(data, memory_test_size / sizeof(float));
+    // Records of the device with id.
+    vector<bench_record> device_records(cl_device_id id) const
+    {
+        lock_guard<mutex> lock(mtx);
+        vector<bench_record> found;
+        for (auto& entry : records)
+            if (entry.first.id == id)
+                found.push_back(entry.second);
+        return found;
+    }
 
-    if (device_index_set) {
-        run_vector_ops(devices[device_index], code, data);
-    } else {
-        for (auto& device : devices)
-            run_vector_ops(device, code, data);
+    // One row per trial, with the fields written by write_json.
+    vector<record_row> rows() const
+    {
+        lock_guard<mutex> lock(mtx);
+        vector<record_row> trials;
+        for (auto& entry : records) {
+            for (unsigned i = 0; i < entry.second.timings.size(); ++i) {
+                trials.emplace_back();
+                for (auto& field : fields(entry.first, entry.second, i))
+                    trials.back()[field.name] = field.value;
+            }
+        }
+        return trials;
+    }
+
+    // One record per trial as CSV with a header line.
+    void write_csv(ostream& out) const
+    {
+        lock_guard<mutex> lock(mtx);
+        bench_record empty = bench_record();
+        empty.timings.resize(1);
+        const char* separator = "";
+        for (auto& field : fields(device_info(), empty, 0)) {
+            out << separator << field.name;
+            separator = ",";
+        }
+        out << endl;
+        for (auto& entry : records) {
+            for (unsigned i = 0; i < entry.second.timings.size(); ++i) {
+                separator = "";
+                for (auto& field : fields(entry.first, entry.second, i)) {
+                    out << separator << csv_string(field.value);
+                    separator = ",";
+                }
+                out << endl;
+            }
+        }
+    }
+
+private:
+    static vector<record_field> fields(const device_info& device,
+                                       const bench_record& record,
+                                       unsigned trial)
+    {
+        const bench_timing& timing = record.timings[trial];
+        sample_stats stats = compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel));
+        return {
+            {"device", device.name, false},
+            {"pci_address", device.pci_address, false},
+            {"vendor", device.vendor, false},
+            {"driver_version", device.driver, false},
+            {"device_version", device.version, false},
+            number_field("compute_units", device.compute_units),
+            number_field("clock_mhz", device.clock_mhz),
+            number_field("global_mem_bytes", device.global_mem),
+            number_field("max_alloc_bytes", device.max_alloc),
+            number_field("local_mem_bytes", device.local_mem),
+            {"benchmark", record.benchmark, false},
+            {"kernel", record.kernel, false},
+            {"config", record.config, false},
+            number_field("work", record.work),
+            {"unit", record.unit, false},
+            number_field("global_size", record.global_size),
+            number_field("local_size", record.local_size),
+            number_field("trial", trial),
+            number_field("trials", record.timings.size()),
+            number_field("kernel_s", timing.kernel),
+            number_field("wall_s", timing.wall),
+            number_field("queued_s", timing.queued),
+            number_field("submitted_s", timing.submitted),
+            number_field("min_s", stats.min),
+            number_field("median_s", stats.median),
+            number_field("p95_s", stats.p95),
+            number_field("max_s", stats.max),
+            number_field("stddev_s", stats.stddev),
+            number_field("throughput_per_s", record.work / stats.median),
+            {"verification", record.verification, false},
+            number_field("flops", record.flops ? record.flops : NAN),
+            number_field("bytes", record.bytes ? record.bytes : NAN),
+        };
+    }
+
+    static string csv_string(const string& text)
+    {
+        if (text.find_first_of(",\"\n") == string::npos)
+            return text;
+        string quoted = "\"";
+        for (char c : text) {
+            if (c == '"')
+                quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    mutable mutex mtx;
+    vector<pair<device_info, bench_record>> records;
+};
+
+result_log results;
+
+// Regressions are only reported when the slowdown is significant at this
+// level.
+const double REGRESSION_ALPHA = 0.05;
+
+// Parse the records of a --format=json run back into rows. Numbers keep
+// their text, so keys built from them match the ones of a new run.
+bool parse_json_rows(const string& text, vector<record_row>& rows)
+{
+    size_t pos = 0;
+    auto skip_space = [&]() {
+        while (pos < text.size() && isspace(text[pos]))
+            ++pos;
+    };
+    auto expect = [&](char c) {
+        skip_space();
+        if (pos >= text.size() || text[pos] != c)
+            return false;
+        ++pos;
+        return true;
+    };
+    auto read_string = [&](string& value) {
+        if (!expect('"'))
+            return false;
+        value.clear();
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c == '\\' && pos < text.size()) {
+                c = text[pos++];
+                if (c == 'u' && pos + 4 <= text.size()) {
+                    c = static_cast<char>(stoi(text.substr(pos, 4), NULL,
+                                               16));
+                    pos += 4;
+                }
+            }
+            value += c;
+        }
+        return expect('"');
+    };
+
+    if (!expect('['))
+        return false;
+    skip_space();
+    if (pos < text.size() && text[pos] == ']')
+        return true;
+    do {
+        if (!expect('{'))
+            return false;
+        rows.emplace_back();
+        do {
+            string name, value;
+            if (!read_string(name) || !expect(':'))
+                return false;
+            skip_space();
+            if (pos < text.size() && text[pos] == '"') {
+                if (!read_string(value))
+                    return false;
+            } else {
+                size_t end = text.find_first_of(",}", pos);
+                if (end == string::npos)
+                    return false;
+                value = text.substr(pos, end - pos);
+                while (!value.empty() && isspace(value.back()))
+                    value.pop_back();
+                if (value == "null")
+                    value.clear();
+                pos = end;
+            }
+            rows.back()[name] = value;
+        } while (expect(','));
+        if (!expect('}'))
+            return false;
+    } while (expect(','));
+    return expect(']');
+}
+
+bool read_json_rows(const string& file_name, vector<record_row>& rows)
+{
+    ifstream file(file_name);
+    if (!file.is_open())
+        return false;
+    return parse_json_rows(string((istreambuf_iterator<char>(file)),
+                                  istreambuf_iterator<char>()), rows);
+}
+
+// Rows of the same configuration share a key: device, kernel,
+// configuration, work and work sizes. The driver is left out, so a run
+// after a driver update still matches its baseline. Rows missing one are
+// left out.
+bool baseline_key(const record_row& row, string& key)
+{
+    key.clear();
+    for (auto name : {"device", "benchmark", "kernel", "config", "work",
+                      "global_size", "local_size"}) {
+        auto field = row.find(name);
+        if (field == row.end())
+            return false;
+        key += field->second + "\n";
+    }
+    return true;
+}
+
+// Trials of one configuration.
+struct baseline_series {
+    record_row first;
+    vector<double> times;
+};
+
+map<string, baseline_series> group_rows(const vector<record_row>& rows)
+{
+    map<string, baseline_series> series;
+    for (auto& row : rows) {
+        string key;
+        auto time = row.find("kernel_s");
+        if (!baseline_key(row, key) || time == row.end() ||
+            time->second.empty())
+            continue;
+        baseline_series& entry = series[key];
+        if (entry.times.empty())
+            entry.first = row;
+        entry.times.push_back(stod(time->second));
+    }
+    return series;
+}
+
+// One sided p-value of the Mann-Whitney U test for the times in slower
+// being larger than those in faster, from the normal approximation with
+// tie and continuity corrections.
+double mann_whitney_p(const vector<double>& faster,
+                      const vector<double>& slower)
+{
+    vector<pair<double, bool>> all;
+    for (auto time : faster)
+        all.push_back({time, false});
+    for (auto time : slower)
+        all.push_back({time, true});
+    sort(all.begin(), all.end());
+
+    double n = all.size();
+    double rank_sum = 0;
+    double ties = 0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first)
+            ++j;
+        double t = j - i;
+        double rank = (i + j + 1) / 2.0;
+        for (size_t k = i; k < j; ++k)
+            if (all[k].second)
+                rank_sum += rank;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    double n1 = faster.size();
+    double n2 = slower.size();
+    double u = rank_sum - n2 * (n2 + 1) / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0)
+        return 1;
+    double z = (u - n1 * n2 / 2 - 0.5) / sqrt(variance);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+// Compare every configuration of the current run with the same one in the
+// baseline and return how many of them regressed: median throughput down
+// by more than threshold and the slowdown significant. matched is set to
+// the number of configurations found in both.
+unsigned compare_baseline(const vector<record_row>& baseline,
+                          const vector<record_row>& current,
+                          double threshold, unsigned& matched)
+{
+    map<string, baseline_series> before = group_rows(baseline);
+    map<string, baseline_series> after = group_rows(current);
+    unsigned regressions = 0;
+    matched = 0;
+
+    cout << "Baseline comparison, median throughput" << endl;
+    cout << setw(30) << left << "Device" << setw(40) << "Configuration"
+         << right << setw(10) << "Change" << setw(10) << "p"
+         << "  Status" << endl;
+    for (auto& entry : after) {
+        const record_row& row = entry.second.first;
+        string name = row.at("benchmark") + " " + row.at("kernel");
+        if (!row.at("config").empty())
+            name += " " + row.at("config");
+        cout << setw(30) << left << row.at("device").substr(0, 29)
+             << setw(40) << name.substr(0, 39) << right;
+
+        auto old = before.find(entry.first);
+        if (old == before.end()) {
+            cout << setw(10) << "-" << setw(10) << "-" << "  new" << endl;
+            continue;
+        }
+        double old_median = compute_stats(old->second.times).median;
+        double new_median = compute_stats(entry.second.times).median;
+        double change = old_median / new_median - 1;
+        double p = mann_whitney_p(old->second.times, entry.second.times);
+        bool regressed = change < -threshold && p < REGRESSION_ALPHA;
+        ++matched;
+        if (regressed)
+            ++regressions;
+        // Formatted apart so that cout keeps its default precision.
+        stringstream percent, probability;
+        percent << fixed << setprecision(1) << change * 100 << "%";
+        probability << setprecision(3) << p;
+        cout << setw(10) << percent.str() << " " << setw(9)
+             << probability.str() << (regressed ? "  REGRESSED" : "  ok");
+        const string& old_driver = old->second.first.at("driver_version");
+        if (old_driver != row.at("driver_version"))
+            cout << "  driver " << old_driver << " -> "
+                 << row.at("driver_version");
+        cout << endl;
+    }
+    for (auto& entry : before) {
+        if (!after.count(entry.first))
+            cout << "Not run: " << entry.second.first.at("benchmark") << " "
+                 << entry.second.first.at("kernel") << " "
+                 << entry.second.first.at("config") << " on "
+                 << entry.second.first.at("device") << endl;
+    }
+    cout << regressions << " regression(s)" << endl;
+    if (!matched)
+        cerr << "No configuration matched the baseline. Check that -s, the "
+             << "device and the benchmarks match the baseline run." << endl;
+    return regressions;
+}
+
+// Time a single profiled command issued by enqueue.
+bench_timing time_command(const function<void(cl::Event*)>& enqueue)
+{
+    cl::Event event;
+    struct timeval tv1, tv2;
+    gettimeofday(&tv1, NULL);
+    enqueue(&event);
+    event.wait();
+    gettimeofday(&tv2, NULL);
+    return event_timing(event, tv1, tv2);
+}
+
+// Upload data and time a single launch of func. A local_size of 0 lets the
+// driver choose the work-group size.
+template <class T>
+bench_timing run_bench_function(cl::CommandQueue& queue, cl::Kernel& func,
+                                const T& data, const cl::Buffer& buff,
+                                size_t global_size, size_t local_size = 1)
+{
+    cl::NDRange global(global_size);
+    cl::NDRange local = local_size ? cl::NDRange(local_size) : cl::NullRange;
+    cl::Event event;
+    struct timeval tv1, tv2;
+
+    {
+        trace_scope scope("upload");
+        queue.enqueueWriteBuffer(buff, CL_TRUE, 0,
+                                 sizeof(typename T::value_type) * data.size(),
+                                 data.data());
+    }
+
+    gettimeofday(&tv1, NULL);
+    queue.enqueueNDRangeKernel(func, cl::NullRange,
+                               global, local, NULL, &event);
+    event.wait();
+    gettimeofday(&tv2, NULL);
+    return event_timing(event, tv1, tv2);
+}
+
+// Chunks read back from the device at a time for verification.
+const size_t VERIFY_BLOCK_CHUNKS = 64;
+
+// Check count results starting at buffer index first, which must be a
+// multiple of DATA_CHUNK_SIZE, on all host cores.
+template <class T>
+verify_result verify_block(const T* block, size_t first, size_t count,
+                           const bench_options& options,
+                           reference_function reference = sqrt_reference)
+{
+    trace_scope scope("verify");
+    verify_result result;
+    mutex mtx;
+    size_t chunks = (count + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+    parallel_chunks(chunks, {}, [&](size_t chunk) {
+        size_t begin = chunk * DATA_CHUNK_SIZE;
+        verify_result part = verify_data(
+            block + begin, first / DATA_CHUNK_SIZE + chunk,
+            min(DATA_CHUNK_SIZE, count - begin),
+            max<size_t>(options.verify_stride, 1), options.max_ulp, T(0),
+            T(1), reference);
+        lock_guard<mutex> lock(mtx);
+        result.merge(part);
+    });
+    return result;
+}
+
+// Read back the buffer contents left by the last launch in blocks and
+// check every verify_stride-th element. This runs outside the timed
+// region.
+template <class T>
+verify_result verify_bench_result(cl::CommandQueue& queue, const T& data,
+                                  const cl::Buffer& buff,
+                                  const bench_options& options,
+                                  reference_function reference =
+                                      sqrt_reference)
+{
+    typedef typename T::value_type value_type;
+    const size_t block_size = VERIFY_BLOCK_CHUNKS * DATA_CHUNK_SIZE;
+    vector<value_type> block(min(block_size, data.size()));
+    verify_result result;
+
+    for (size_t first = 0; first < data.size(); first += block_size) {
+        size_t count = min(block_size, data.size() - first);
+        {
+            trace_scope scope("readback");
+            queue.enqueueReadBuffer(buff, CL_TRUE, sizeof(value_type) * first,
+                                    sizeof(value_type) * count, block.data());
+        }
+        result.merge(verify_block(block.data(), first, count, options,
+                                  reference));
+    }
+    return result;
+}
+
+// Verification status as stored in result records.
+string verification_status(bool passed)
+{
+    return passed ? "passed" : "failed";
+}
+
+// Print a failed verification to err and return whether it passed.
+bool check_verification(const verify_result& result,
+                        const bench_options& options, ostream& err = cerr)
+{
+    if (result.passed())
+        return true;
+    err << "Invalid computation from device: " << result.mismatched
+        << " of " << result.checked << " elements off by more than "
+        << options.max_ulp << " ulp, worst " << result.worst_ulp << " ulp"
+        << endl;
+    return false;
+}
+
+// Half precision bits of value, rounded to nearest even.
+cl_half float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    // Subnormal halves keep the implicit bit in the mantissa.
+    unsigned shift = 13;
+    uint32_t half;
+    if (exponent > 0) {
+        half = (exponent << 10) | (mantissa >> shift);
+    } else {
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+    }
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+double half_to_double(cl_half half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 31)
+        value = mantissa ? numeric_limits<double>::quiet_NaN() :
+            numeric_limits<double>::infinity();
+    else if (exponent == 0)
+        value = ldexp(mantissa, -24);
+    else
+        value = ldexp(mantissa | 0x400, exponent - 25);
+    return half & 0x8000 ? -value : value;
+}
+
+// Element type the vectorops.cl and flops.cl kernels are built for: the
+// build options that select it, the extension it needs, if any, and the
+// size of one element.
+struct element_type {
+    string name;
+    string build_options;
+    string extension;
+    size_t size;
+    bool integer;
+};
+
+const element_type FLOAT_TYPE = {"float", "-DTYPE=float", "",
+                                 sizeof(cl_float), false};
+const element_type DOUBLE_TYPE = {"double", "-DTYPE=double -DUSE_FP64",
+                                  "cl_khr_fp64", sizeof(cl_double), false};
+const element_type HALF_TYPE = {"half", "-DTYPE=half -DUSE_FP16",
+                                "cl_khr_fp16", sizeof(cl_half), false};
+const element_type INT_TYPE = {"int", "-DTYPE=int -DINTEGER", "",
+                               sizeof(cl_int), true};
+const vector<element_type> ELEMENT_TYPES = {FLOAT_TYPE, DOUBLE_TYPE,
+                                            HALF_TYPE, INT_TYPE};
+
+// Element types of the types benchmark on the host: how the float test
+// data is stored in each, the host reference of the vectorops.cl kernels
+// and the error of a result in units in the last place.
+template<class T>
+struct element_traits;
+
+template<>
+struct element_traits<cl_float> {
+    static const element_type& type() { return FLOAT_TYPE; }
+    static cl_float encode(float x) { return x; }
+    static double decode(cl_float x) { return x; }
+    static double reference(double x) { return sqrt(x); }
+    static double error(double value, double reference)
+    {
+        return ulp_error<float>(value, reference);
+    }
+};
+
+template<>
+struct element_traits<cl_double> {
+    static const element_type& type() { return DOUBLE_TYPE; }
+    static cl_double encode(float x) { return x; }
+    static double decode(cl_double x) { return x; }
+    static double reference(double x) { return sqrt(x); }
+    static double error(double value, double reference)
+    {
+        return ulp_error<double>(value, reference);
+    }
+};
+
+template<>
+struct element_traits<cl_half> {
+    static const element_type& type() { return HALF_TYPE; }
+    static cl_half encode(float x) { return float_to_half(x); }
+    static double decode(cl_half x) { return half_to_double(x); }
+    static double reference(double x) { return sqrt(x); }
+    static double error(double value, double reference)
+    {
+        if (value == reference)
+            return 0;
+        if (isnan(value) || isnan(reference))
+            return numeric_limits<double>::infinity();
+        // Spacing of halves around reference; subnormals share 2^-24.
+        int exponent = reference ? max(ilogb(reference), -14) : -14;
+        return fabs(value - reference) / ldexp(1.0, exponent - 10);
+    }
+};
+
+// Integers are the test data scaled to [0, INT_DATA_SCALE) and their
+// square roots truncated, so results have to match exactly.
+const float INT_DATA_SCALE = 1 << 20;
+
+template<>
+struct element_traits<cl_int> {
+    static const element_type& type() { return INT_TYPE; }
+    static cl_int encode(float x) { return x * INT_DATA_SCALE; }
+    static double decode(cl_int x) { return x; }
+    static double reference(double x) { return floor(sqrt(x)); }
+    static double error(double value, double reference)
+    {
+        return value == reference ? 0 : numeric_limits<double>::infinity();
+    }
+};
+
+// Verify every verify_stride-th element of result against the reference
+// applied to input, on all host cores.
+template<class T>
+verify_result verify_elements(const vector<T>& result, const vector<T>& input,
+                              const bench_options& options)
+{
+    typedef element_traits<T> traits;
+    verify_result verified;
+    mutex mtx;
+    size_t stride = max<size_t>(options.verify_stride, 1);
+    size_t chunks = (result.size() + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+    parallel_chunks(chunks, {}, [&](size_t chunk) {
+        verify_result part;
+        size_t end = min(result.size(), (chunk + 1) * DATA_CHUNK_SIZE);
+        for (size_t i = chunk * DATA_CHUNK_SIZE; i < end; ++i) {
+            if (i % stride)
+                continue;
+            double error = traits::error(
+                traits::decode(result[i]),
+                traits::reference(traits::decode(input[i])));
+            ++part.checked;
+            part.worst_ulp = max(part.worst_ulp, error);
+            if (!(error <= options.max_ulp))
+                ++part.mismatched;
+        }
+        lock_guard<mutex> lock(mtx);
+        verified.merge(part);
+    });
+    return verified;
+}
+
+void print_stats_row(const string& name, const vector<double>& samples)
+{
+    sample_stats stats = compute_stats(samples);
+    cout << "  " << setw(13) << left << name << right
+         << setw(12) << stats.min * 1.0E3
+         << setw(12) << stats.median * 1.0E3
+         << setw(12) << stats.p95 * 1.0E3
+         << setw(12) << stats.max * 1.0E3
+         << setw(12) << stats.stddev * 1.0E3 << endl;
+}
+
+// Run warmup and measured launches of func, then report statistics.
+template <class T>
+void run_trials(cl::CommandQueue& queue, cl::Kernel& func, const T& data,
+                const cl::Buffer& buff, size_t global_size,
+                const bench_options& options, size_t local_size = 1)
+{
+    vector<bench_timing> timings = collect_trials(options, [&]() {
+        return run_bench_function(queue, func, data, buff, global_size,
+                                  local_size);
+    });
+    vector<double> kernel = timing_samples(timings, &bench_timing::kernel);
+
+    struct timeval tv1, tv2;
+    gettimeofday(&tv1, NULL);
+    verify_result verified = verify_bench_result(queue, data, buff, options);
+    gettimeofday(&tv2, NULL);
+    results.add(queue.getInfo<CL_QUEUE_DEVICE>(),
+                {"vector", func.getInfo<CL_KERNEL_FUNCTION_NAME>(), "",
+                 static_cast<double>(data.size()), "elements", global_size,
+                 local_size, timings, verification_status(verified.passed()),
+                 static_cast<double>(data.size()), 8.0 * data.size()});
+    if (!check_verification(verified, options))
+        return;
+
+    sample_stats stats = compute_stats(kernel);
+    cout << data.size() / stats.median / 1.0E6
+         << "M Elements Per Second (median of " << kernel.size()
+         << " trials, local size "
+         << (local_size ? to_string(local_size) : "auto") << ")" << endl;
+    cout << setw(15) << "" << setw(12) << "Min" << setw(12) << "Median"
+         << setw(12) << "P95" << setw(12) << "Max"
+         << setw(12) << "Stddev" << endl;
+    print_stats_row("Kernel ms", kernel);
+    print_stats_row("Wall ms", timing_samples(timings, &bench_timing::wall));
+    print_stats_row("Queue ms", timing_samples(timings, &bench_timing::queued));
+    print_stats_row("Submit ms",
+                    timing_samples(timings, &bench_timing::submitted));
+    cout << "  Verified " << verified.checked << " elements, worst error "
+         << verified.worst_ulp << " ulp (limit " << options.max_ulp << "), "
+         << elapsed(tv1, tv2) * 1.0E3 << " ms" << endl;
+}
+
+// Directory for results kept between runs, created on first use.
+string cache_dir()
+{
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    string base = xdg && *xdg ? xdg : string(home ? home : ".") + "/.cache";
+    mkdir(base.c_str(), 0755);
+    string dir = base + "/clbench";
+    mkdir(dir.c_str(), 0755);
+    return dir;
+}
+
+// Read a CL source file.
+string read_source(const string& file_name)
+{
+    ifstream source_file(file_name);
+    if (!source_file.is_open()) {
+        cerr << "Error opening " << file_name << " for reading "<< endl;
+        exit(1);
+    }
+    return string((istreambuf_iterator<char>(source_file)),
+                  istreambuf_iterator<char>());
+}
+
+// 64-bit FNV-1a hash, stable across runs and compilers.
+uint64_t fnv1a(const string& text)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Cache file for the binary of code built for device with build_options.
+// The key covers everything that can change the compiled result.
+string program_cache_file(cl::Device& device, const string& code,
+                          const string& build_options)
+{
+    cl::Platform platform(device.getInfo<CL_DEVICE_PLATFORM>());
+    stringstream key;
+    key << code << '\0' << build_options << '\0'
+        << device.getInfo<CL_DEVICE_NAME>() << '\0'
+        << device.getInfo<CL_DRIVER_VERSION>() << '\0'
+        << platform.getInfo<CL_PLATFORM_VERSION>();
+    stringstream name;
+    name << hex << setw(16) << setfill('0') << fnv1a(key.str());
+    string dir = cache_dir() + "/programs";
+    mkdir(dir.c_str(), 0755);
+    return dir + "/" + name.str() + ".bin";
+}
+
+// Load a cached program binary. Cache files hold the cold build time in
+// seconds on the first line, followed by the binary.
+bool load_program_binary(const string& file_name, double& cold_time,
+                         vector<char>& binary)
+{
+    ifstream file(file_name, ios::binary);
+    string line;
+    if (!getline(file, line))
+        return false;
+    stringstream(line) >> cold_time;
+    binary.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return !binary.empty();
+}
+
+void store_program_binary(const string& file_name, cl::Program& program,
+                          double cold_time)
+{
+    size_t size = 0;
+    clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(size),
+                     &size, NULL);
+    if (!size)
+        return;
+    vector<char> binary(size);
+    char* ptr = binary.data();
+    clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(ptr), &ptr, NULL);
+    // Threads and processes may store the same program at once, so each
+    // writes its own file and renames it into place whole.
+    static atomic<unsigned> stores(0);
+    string temp_name = file_name + "." + to_string(getpid()) + "." +
+                       to_string(stores++);
+    ofstream file(temp_name, ios::binary);
+    file << cold_time << "\n";
+    file.write(binary.data(), binary.size());
+    file.close();
+    if (!file || rename(temp_name.c_str(), file_name.c_str()))
+        remove(temp_name.c_str());
+}
+
+// Record a build of code for device taking seconds, as a "cold" build
+// from source or a "warm" one from the cached binary. Programs are told
+// apart by a hash of their source and their build options.
+void record_build(cl::Device& device, const string& code,
+                  const string& build_options, const string& kind,
+                  double seconds)
+{
+    stringstream config;
+    config << "source=" << hex << setw(8) << setfill('0')
+           << (fnv1a(code) & 0xffffffff);
+    if (!build_options.empty())
+        config << " " << build_options;
+    results.add(device, {"build", kind, config.str(), 1, "builds", 0, 0,
+                         {host_timing(seconds)}, ""});
+}
+
+// Compile code for device with the given build options into program.
+// Binaries are cached on disk so later runs skip the compiler; the cold
+// and warm build times are written to log and recorded. On failure the
+// build log is left in program and false is returned.
+bool try_build_program(cl::Context& context, cl::Device& device,
+                       const string& code, const string& build_options,
+                       cl::Program& program, ostream& log = cout)
+{
+    string cache_file = program_cache_file(device, code, build_options);
+    struct timeval tv1, tv2;
+    double cold_time;
+    vector<char> binary;
+
+    gettimeofday(&tv1, NULL);
+    if (load_program_binary(cache_file, cold_time, binary)) {
+        cl::Program::Binaries binaries;
+        binaries.push_back({binary.data(), binary.size()});
+        cl_int err = CL_SUCCESS;
+        program = cl::Program(context, {device}, binaries, NULL, &err);
+        if (err == CL_SUCCESS &&
+            program.build({device}, build_options.c_str()) == CL_SUCCESS) {
+            gettimeofday(&tv2, NULL);
+            log << "Program build: " << elapsed(tv1, tv2) * 1.0E3
+                << " ms warm, " << cold_time * 1.0E3 << " ms cold" << endl;
+            record_build(device, code, build_options, "warm",
+                         elapsed(tv1, tv2));
+            return true;
+        }
+        // A stale or rejected binary falls through to a source build.
+        gettimeofday(&tv1, NULL);
+    }
+
+    cl::Program::Sources source;
+    source.push_back({code.c_str(), code.length()});
+    program = cl::Program(context, source);
+    if (program.build({device}, build_options.c_str()) != CL_SUCCESS)
+        return false;
+    gettimeofday(&tv2, NULL);
+    cold_time = elapsed(tv1, tv2);
+    log << "Program build: " << cold_time * 1.0E3 << " ms cold" << endl;
+    record_build(device, code, build_options, "cold", cold_time);
+    store_program_binary(cache_file, program, cold_time);
+    return true;
+}
+
+// Compile code for device with the given build options, exiting with the
+// build log on failure.
+cl::Program build_program(cl::Context& context, cl::Device& device,
+                          const string& code, const string& build_options = "",
+                          ostream& log = cout)
+{
+    trace_scope scope("build");
+    cl::Program program;
+    if (!try_build_program(context, device, code, build_options, program,
+                           log)) {
+        cerr << "Error building. Verify OpenCL installation." << endl;
+        cout << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << endl;
+        exit(1);
+    }
+    return program;
+}
+
+// Key for a tuned work-group size. Results only carry over to the same
+// device, driver and launch size.
+string work_size_key(cl::Device& device, const string& kernel,
+                     size_t global_size)
+{
+    return device.getInfo<CL_DEVICE_NAME>() + "\t" +
+        device.getInfo<CL_DRIVER_VERSION>() + "\t" + kernel + "\t" +
+        to_string(global_size);
+}
+
+// Read tuned work-group sizes stored by earlier runs.
+map<string, size_t> load_work_sizes()
+{
+    map<string, size_t> sizes;
+    ifstream file(cache_dir() + "/" + WORK_SIZE_FILE_NAME);
+    string line;
+    while (getline(file, line)) {
+        size_t tab = line.rfind('\t');
+        if (tab == string::npos)
+            continue;
+        stringstream(line.substr(tab + 1)) >> sizes[line.substr(0, tab)];
+    }
+    return sizes;
+}
+
+void store_work_size(const string& key, size_t local_size)
+{
+    map<string, size_t> sizes = load_work_sizes();
+    sizes[key] = local_size;
+    ofstream file(cache_dir() + "/" + WORK_SIZE_FILE_NAME);
+    for (auto& entry : sizes)
+        file << entry.first << "\t" << entry.second << endl;
+}
+
+// Tuned work-group size for kernel, or fallback if it was never tuned.
+size_t cached_work_size(cl::Device& device, const string& kernel,
+                        size_t global_size, size_t fallback)
+{
+    map<string, size_t> sizes = load_work_sizes();
+    auto it = sizes.find(work_size_key(device, kernel, global_size));
+    return it == sizes.end() ? fallback : it->second;
+}
+
+// Launch sizes of one of the vectorops.cl kernels.
+struct vector_op_sizes {
+    size_t global_size;
+    size_t local_size;
+};
+
+// Launch sizes of kernel name over size elements: one range per compute
+// unit for range_op, whose size argument is set here, else a work-item
+// per width elements. The work-group size is the tuned one, or 1 if the
+// kernel was never tuned, so every benchmark launches them alike.
+vector_op_sizes vector_op_launch(cl::Device& device, cl::Kernel& kernel,
+                                 const string& name, size_t size,
+                                 unsigned width = 1)
+{
+    vector_op_sizes sizes;
+    if (name == "range_op") {
+        kernel.setArg(1, static_cast<int>(size));
+        sizes.global_size = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    } else {
+        sizes.global_size = size / width;
+    }
+    sizes.local_size = cached_work_size(device, name, sizes.global_size, 1);
+    return sizes;
+}
+
+// Compile and run benchmarking functions on OpenCL device.
+void run_vector_ops(cl::Device& device, const string& code,
+                    const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::Buffer buff;
+    {
+        trace_scope scope("allocate");
+        buff = cl::Buffer(context, CL_MEM_READ_WRITE,
+                          sizeof(float) * data.size());
+    }
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    // Run range based benchmark
+    cout << setw(15) << left << "Range Based:" << right;
+    cl::Kernel range_op(program, "range_op");
+    range_op.setArg(0, buff);
+    vector_op_sizes sizes = vector_op_launch(device, range_op, "range_op",
+                                             data.size());
+    run_trials(queue, range_op, data, buff, sizes.global_size, options,
+               sizes.local_size);
+
+    // Run element based benchmark
+    cout << setw(15) << left << "Element Based:" << right;
+    cl::Kernel element_op(program, "element_op");
+    element_op.setArg(0, buff);
+    sizes = vector_op_launch(device, element_op, "element_op", data.size());
+    run_trials(queue, element_op, data, buff, sizes.global_size, options,
+               sizes.local_size);
+}
+
+// Host reference of a kernel descriptor and the largest error in ulp it
+// accepts by default, the OpenCL full profile limit of the function.
+struct host_reference {
+    reference_function function;
+    double max_ulp;
+};
+
+// Host references a kernel descriptor can name for verification.
+const map<string, host_reference> HOST_REFERENCES = {
+    {"sqrt", {sqrt_reference, 3}},
+    {"rsqrt", {[](double x) { return 1 / sqrt(x); }, 2}},
+    {"copy", {[](double x) { return x; }, 0}},
+    {"square", {[](double x) { return x * x; }, 0.5}},
+    {"exp", {[](double x) { return exp(x); }, 3}},
+    {"log", {[](double x) { return log(x); }, 3}},
+    {"sin", {[](double x) { return sin(x); }, 4}},
+    {"cos", {[](double x) { return cos(x); }, 4}},
+};
+
+// Argument of a user kernel: "data" is a float buffer uploaded with the
+// test data before every launch, "output" a float buffer of the same
+// size, "count" the element count as an int, "float:<v>" and "int:<v>"
+// scalars and "local:<bytes>" local memory.
+struct kernel_arg {
+    string kind;
+    string value;
+};
+
+// Kernel benchmarked through a descriptor file. global and local are
+// sizes in terms of "count" and "units" (compute units), e.g. "count/4"
+// or "units*64"; a local size of 0 lets the driver choose. A max_ulp
+// below 0 takes the default of the reference.
+struct kernel_descriptor {
+    string name;
+    string file;
+    string kernel;
+    string build_options;
+    vector<kernel_arg> args;
+    string global;
+    string local;
+    double flops;
+    double bytes;
+    string reference;
+    double max_ulp;
+};
+
+// Size given as "count", "units" or a number, optionally followed by
+// "*<n>" or "/<n>". Returns false if expression is none of these.
+bool descriptor_size(const string& expression, size_t count, size_t units,
+                     size_t& size)
+{
+    auto number = [](const string& text, size_t& value) {
+        char* end = NULL;
+        value = strtoul(text.c_str(), &end, 10);
+        return !text.empty() && *end == '\0';
+    };
+    size_t op = expression.find_first_of("*/");
+    string base = expression.substr(0, op);
+    if (base == "count")
+        size = count;
+    else if (base == "units")
+        size = units;
+    else if (!number(base, size))
+        return false;
+    if (op == string::npos)
+        return true;
+    size_t factor;
+    if (!number(expression.substr(op + 1), factor) || !factor)
+        return false;
+    size = expression[op] == '*' ? size * factor : size / factor;
+    return true;
+}
+
+// Read the kernels of an INI style descriptor file, one section per
+// kernel:
+//
+//   [saxpy]
+//   file = saxpy.cl
+//   kernel = saxpy
+//   args = data, output, float:2.0, count
+//   global = count
+//   flops = 2
+//   bytes = 8
+//
+// Kernel files are relative to the descriptor. Errors are printed.
+bool load_kernel_descriptors(const string& file_name,
+                             vector<kernel_descriptor>& descriptors)
+{
+    ifstream file(file_name);
+    if (!file.is_open()) {
+        cerr << "Error opening " << file_name << " for reading" << endl;
+        return false;
+    }
+    size_t slash = file_name.rfind('/');
+    string dir = slash == string::npos ? "" : file_name.substr(0, slash + 1);
+    auto trim = [](const string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        size_t end = text.find_last_not_of(" \t\r");
+        return begin == string::npos ? "" : text.substr(begin,
+                                                        end - begin + 1);
+    };
+
+    size_t first = descriptors.size();
+    string line;
+    for (unsigned number = 1; getline(file, line); ++number) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        if (line[0] == '[' && line.back() == ']') {
+            kernel_descriptor descriptor = kernel_descriptor();
+            descriptor.name = trim(line.substr(1, line.size() - 2));
+            descriptor.kernel = descriptor.name;
+            descriptor.global = "count";
+            descriptor.local = "0";
+            descriptor.max_ulp = -1;
+            descriptors.push_back(descriptor);
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == string::npos || descriptors.size() == first) {
+            cerr << file_name << ":" << number << ": expected [name] or "
+                 << "key = value" << endl;
+            return false;
+        }
+        kernel_descriptor& descriptor = descriptors.back();
+        string key = trim(line.substr(0, equals));
+        string value = trim(line.substr(equals + 1));
+        size_t size;
+        if (key == "file") {
+            descriptor.file = !value.empty() && value[0] == '/' ? value :
+                dir + value;
+            // Found now rather than after other benchmarks have run.
+            if (!ifstream(descriptor.file).is_open()) {
+                cerr << file_name << ":" << number << ": cannot open \""
+                     << descriptor.file << "\"" << endl;
+                return false;
+            }
+        } else if (key == "kernel") {
+            descriptor.kernel = value;
+        } else if (key == "options") {
+            descriptor.build_options = value;
+        } else if (key == "args") {
+            stringstream ss(value);
+            string arg;
+            while (getline(ss, arg, ',')) {
+                arg = trim(arg);
+                size_t colon = arg.find(':');
+                kernel_arg parsed = {arg.substr(0, colon),
+                                     colon == string::npos ? "" :
+                                     arg.substr(colon + 1)};
+                if (parsed.kind != "data" && parsed.kind != "output" &&
+                    parsed.kind != "count" && parsed.kind != "float" &&
+                    parsed.kind != "int" && parsed.kind != "local") {
+                    cerr << file_name << ":" << number << ": unknown "
+                         << "argument \"" << arg << "\"" << endl;
+                    return false;
+                }
+                descriptor.args.push_back(parsed);
+            }
+        } else if ((key == "global" || key == "local") &&
+                   !descriptor_size(value, 1, 1, size)) {
+            cerr << file_name << ":" << number << ": invalid size \""
+                 << value << "\"" << endl;
+            return false;
+        } else if (key == "global") {
+            descriptor.global = value;
+        } else if (key == "local") {
+            descriptor.local = value;
+        } else if (key == "flops") {
+            stringstream(value) >> descriptor.flops;
+        } else if (key == "bytes") {
+            stringstream(value) >> descriptor.bytes;
+        } else if (key == "reference") {
+            if (!HOST_REFERENCES.count(value)) {
+                cerr << file_name << ":" << number << ": unknown reference "
+                     << "\"" << value << "\"" << endl;
+                return false;
+            }
+            descriptor.reference = value;
+        } else if (key == "ulp") {
+            char* end = NULL;
+            descriptor.max_ulp = strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || descriptor.max_ulp < 0) {
+                cerr << file_name << ":" << number << ": invalid ulp \""
+                     << value << "\"" << endl;
+                return false;
+            }
+        } else {
+            cerr << file_name << ":" << number << ": unknown key \"" << key
+                 << "\"" << endl;
+            return false;
+        }
+    }
+
+    for (size_t i = first; i < descriptors.size(); ++i) {
+        if (descriptors[i].file.empty()) {
+            cerr << file_name << ": kernel " << descriptors[i].name
+                 << " has no file" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run the kernels of the descriptor files over the test data with the
+// same trials and verification as the built in benchmarks.
+void run_kernel_ops(cl::Device& device,
+                    const vector<kernel_descriptor>& descriptors,
+                    const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    cl::Buffer input(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+    bool uses_output = false;
+    for (auto& descriptor : descriptors)
+        for (auto& arg : descriptor.args)
+            uses_output |= arg.kind == "output";
+    cl::Buffer output;
+    if (uses_output)
+        output = cl::Buffer(context, CL_MEM_READ_WRITE,
+                            sizeof(float) * data.size());
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    size_t count = data.size();
+
+    for (auto& descriptor : descriptors) {
+        cout << setw(15) << left << descriptor.name + ":" << right;
+        cl::Program program;
+        cl_int err = CL_SUCCESS;
+        if (!try_build_program(context, device,
+                               read_source(descriptor.file),
+                               descriptor.build_options, program)) {
+            cout << "build failed" << endl;
+            continue;
+        }
+        cl::Kernel kernel(program, descriptor.kernel.c_str(), &err);
+        if (err != CL_SUCCESS) {
+            cout << "no kernel " << descriptor.kernel << endl;
+            continue;
+        }
+
+        // Verify the output buffer, or the data buffer updated in place.
+        const cl::Buffer* result = &input;
+        for (cl_uint i = 0; i < descriptor.args.size(); ++i) {
+            const kernel_arg& arg = descriptor.args[i];
+            if (arg.kind == "data") {
+                kernel.setArg(i, input);
+            } else if (arg.kind == "output") {
+                kernel.setArg(i, output);
+                result = &output;
+            } else if (arg.kind == "count") {
+                kernel.setArg(i, static_cast<cl_int>(count));
+            } else if (arg.kind == "float") {
+                kernel.setArg(i, static_cast<cl_float>(atof(
+                    arg.value.c_str())));
+            } else if (arg.kind == "int") {
+                kernel.setArg(i, static_cast<cl_int>(atoi(
+                    arg.value.c_str())));
+            } else {
+                kernel.setArg(i, static_cast<size_t>(atol(
+                    arg.value.c_str())), NULL);
+            }
+        }
+        size_t global_size, local_size;
+        descriptor_size(descriptor.global, count, units, global_size);
+        descriptor_size(descriptor.local, count, units, local_size);
+
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return run_bench_function(queue, kernel, data, input,
+                                      global_size, local_size);
+        });
+        string status;
+        if (!descriptor.reference.empty()) {
+            const host_reference& reference =
+                HOST_REFERENCES.at(descriptor.reference);
+            bench_options limited = options;
+            if (!options.max_ulp_set)
+                limited.max_ulp = descriptor.max_ulp >= 0 ?
+                    descriptor.max_ulp : reference.max_ulp;
+            verify_result verified = verify_bench_result(
+                queue, data, *result, limited, reference.function);
+            status = verification_status(verified.passed());
+            check_verification(verified, limited);
+        }
+        double median = results.add(
+            device, {"kernels", descriptor.kernel, descriptor.name,
+                     static_cast<double>(count), "elements", global_size,
+                     local_size, timings, status, descriptor.flops * count,
+                     descriptor.bytes * count});
+
+        cout << count / median / 1.0E6 << "M Elements Per Second";
+        if (descriptor.flops)
+            cout << ", " << descriptor.flops * count / median / 1.0E9
+                 << " GFLOPS";
+        if (descriptor.bytes)
+            cout << ", " << descriptor.bytes * count / median / 1.0E9
+                 << " GB/s";
+        cout << endl;
+    }
+}
+
+// Work-group sizes worth trying for kernel: powers of two and multiples
+// of the preferred multiple, up to the kernel and device limits. Sizes
+// that do not divide global_size are skipped.
+vector<size_t> work_size_candidates(cl::Device& device, cl::Kernel& kernel,
+                                    size_t global_size)
+{
+    size_t limit = min(
+        kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+        device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    size_t multiple = kernel.getWorkGroupInfo<
+        CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+
+    vector<size_t> sizes;
+    for (size_t size = 1; size <= limit; size *= 2)
+        sizes.push_back(size);
+    for (size_t size = multiple; multiple && size <= limit; size += multiple)
+        sizes.push_back(size);
+    sort(sizes.begin(), sizes.end());
+    sizes.erase(unique(sizes.begin(), sizes.end()), sizes.end());
+    sizes.erase(remove_if(sizes.begin(), sizes.end(), [&](size_t size) {
+        return global_size % size != 0;
+    }), sizes.end());
+    return sizes;
+}
+
+// Time kernel at every candidate work-group size, print the results and
+// store the fastest in the work-group size cache.
+template <class T>
+void tune_work_size(cl::Device& device, cl::CommandQueue& queue,
+                    cl::Kernel& kernel, const string& name, const T& data,
+                    const cl::Buffer& buff, size_t global_size,
+                    const bench_options& options)
+{
+    size_t best_size = 0;
+    double best_time = numeric_limits<double>::max();
+    vector<bench_record> records;
+    for (auto local_size : work_size_candidates(device, kernel, global_size)) {
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return run_bench_function(queue, kernel, data, buff, global_size,
+                                      local_size);
+        });
+        records.push_back({"tune", name, "", static_cast<double>(data.size()),
+                           "elements", global_size, local_size, timings, ""});
+        sample_stats stats = compute_stats(
+            timing_samples(timings, &bench_timing::kernel));
+        cout << setw(15) << left << name << right << setw(10) << local_size
+             << setw(12) << data.size() / stats.median / 1.0E6
+             << setw(12) << stats.median * 1.0E3 << endl;
+        if (stats.median < best_time) {
+            best_time = stats.median;
+            best_size = local_size;
+        }
+    }
+
+    // Only the result of the last candidate is left to check.
+    bool passed = check_verification(
+        verify_bench_result(queue, data, buff, options), options);
+    for (auto& record : records) {
+        record.verification = verification_status(passed);
+        results.add(device, record);
+    }
+    if (!passed)
+        return;
+    cout << name << ": best local size " << best_size << ", "
+         << data.size() / best_time / 1.0E6 << "M Elements Per Second"
+         << endl;
+    store_work_size(work_size_key(device, name, global_size), best_size);
+}
+
+// Find the fastest work-group size of each vector kernel. The results are
+// cached and used by later runs of the vector benchmark.
+void run_tune_ops(cl::Device& device, const string& code,
+                  const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    cout << setw(15) << left << "Kernel" << right << setw(10) << "Local"
+         << setw(12) << "M/s" << setw(12) << "Kernel ms" << endl;
+
+    cl::Kernel range_op(program, "range_op");
+    range_op.setArg(0, buff);
+    int size = data.size();
+    range_op.setArg(1, size);
+    size_t nthreads = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    tune_work_size(device, queue, range_op, "range_op", data, buff, nthreads,
+                   options);
+
+    cl::Kernel element_op(program, "element_op");
+    element_op.setArg(0, buff);
+    tune_work_size(device, queue, element_op, "element_op", data, buff,
+                   data.size(), options);
+}
+
+// Run element_op over float, float2, ... float16 elements and report the
+// throughput of each width. The device's preferred width is marked.
+void run_width_ops(cl::Device& device, const string& code,
+                   const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    unsigned preferred =
+        device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>();
+
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+
+    cout << setw(15) << left << "Width" << right << setw(12) << "M/s"
+         << setw(12) << "Kernel ms" << setw(12) << "Stddev ms" << endl;
+    for (unsigned width = 1; width <= 16; width *= 2) {
+        string name = width == 1 ? "element_op" :
+            "element_op" + to_string(width);
+        cl::Kernel kernel(program, name.c_str());
+        kernel.setArg(0, buff);
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return run_bench_function(queue, kernel, data, buff,
+                                      data.size() / width, 0);
+        });
+        verify_result verified = verify_bench_result(queue, data, buff,
+                                                     options);
+        results.add(device, {"width", name, "float" + to_string(width),
+                             static_cast<double>(data.size()), "elements",
+                             data.size() / width, 0, timings,
+                             verification_status(verified.passed()),
+                             static_cast<double>(data.size()),
+                             8.0 * data.size()});
+        if (!check_verification(verified, options))
+            continue;
+        sample_stats stats = compute_stats(
+            timing_samples(timings, &bench_timing::kernel));
+        cout << setw(15) << left
+             << ("float" + (width == 1 ? "" : to_string(width)) +
+                 (width == preferred ? " *" : "")) << right
+             << setw(12) << data.size() / stats.median / 1.0E6
+             << setw(12) << stats.median * 1.0E3
+             << setw(12) << stats.stddev * 1.0E3 << endl;
+    }
+}
+
+// Build options tried by the options benchmark when no -b axes are given,
+// each on its own.
+const vector<string> DEFAULT_BUILD_OPTIONS{
+    "", "-cl-fast-relaxed-math", "-cl-mad-enable", "-cl-denorms-are-zero",
+    "-cl-std=CL2.0", "-DSQRT=native_sqrt"};
+
+// Every combination of one alternative per axis, joined by spaces.
+vector<string> build_option_combinations(const vector<vector<string>>& axes)
+{
+    vector<string> combinations{""};
+    for (auto& axis : axes) {
+        vector<string> next;
+        for (auto& prefix : combinations)
+            for (auto& alternative : axis)
+                next.push_back(prefix.empty() || alternative.empty() ?
+                               prefix + alternative :
+                               prefix + " " + alternative);
+        combinations = next;
+    }
+    return combinations;
+}
+
+// Build the vector kernels under every combination of build options and
+// report throughput next to the worst error against the host reference,
+// so the precision cost of each option is visible.
+void run_build_option_ops(cl::Device& device, const string& code,
+                          const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+    vector<string> combinations = options.build_axes.empty() ?
+        DEFAULT_BUILD_OPTIONS : build_option_combinations(options.build_axes);
+
+    cout << setw(40) << left << "Options" << setw(15) << "Kernel" << right
+         << setw(12) << "M/s" << setw(12) << "Worst ulp" << endl;
+    for (auto& build_options : combinations) {
+        string label = build_options.empty() ? "(none)" : build_options;
+        cl::Program program;
+        if (!try_build_program(context, device, code, build_options,
+                               program)) {
+            cout << setw(40) << left << label << "build failed" << right
+                 << endl;
+            continue;
+        }
+        // Width 0 stands for range_op over one range per compute unit.
+        for (unsigned width : {0u, 1u, 2u, 4u, 8u, 16u}) {
+            string name = width == 0 ? "range_op" : width == 1 ?
+                "element_op" : "element_op" + to_string(width);
+            cl::Kernel kernel(program, name.c_str());
+            kernel.setArg(0, buff);
+            vector_op_sizes sizes = vector_op_launch(
+                device, kernel, name, data.size(), max(1u, width));
+            size_t global_size = sizes.global_size;
+            size_t local_size = sizes.local_size;
+            vector<bench_timing> timings = collect_trials(options, [&]() {
+                return run_bench_function(queue, kernel, data, buff,
+                                          global_size, local_size);
+            });
+            verify_result verified = verify_bench_result(queue, data, buff,
+                                                         options);
+            double median = results.add(
+                device, {"options", name, build_options,
+                         static_cast<double>(data.size()), "elements",
+                         global_size, local_size, timings,
+                         verification_status(verified.passed())});
+            cout << setw(40) << left << label.substr(0, 39)
+                 << setw(15) << name << right
+                 << setw(12) << data.size() / median / 1.0E6
+                 << setw(12) << verified.worst_ulp
+                 << (verified.passed() ? "" : "  failed") << endl;
+        }
+    }
+}
+
+// Horizontal bar of up to width characters for value relative to peak.
+string ascii_bar(double value, double peak, unsigned width = 40)
+{
+    return string(peak > 0 ? static_cast<size_t>(value / peak * width) : 0,
+                  '#');
+}
+
+// Sweep the global size of range_op and range_stride_op from one wavefront
+// per compute unit up to 1024, and plot throughput against global size.
+void run_occupancy_ops(cl::Device& device, const string& code,
+                       const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    int size = data.size();
+
+    for (string name : {"range_op", "range_stride_op"}) {
+        cl::Kernel kernel(program, name.c_str());
+        kernel.setArg(0, buff);
+        kernel.setArg(1, size);
+        size_t wavefront = kernel.getWorkGroupInfo<
+            CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+
+        vector<size_t> global_sizes;
+        vector<double> throughput;
+        for (size_t waves = 1; waves <= 1024; waves *= 2) {
+            size_t global_size = units * waves * wavefront;
+            if (global_size > data.size())
+                break;
+            vector<bench_timing> timings = collect_trials(options, [&]() {
+                return run_bench_function(queue, kernel, data, buff,
+                                          global_size, wavefront);
+            });
+            verify_result verified = verify_bench_result(queue, data, buff,
+                                                         options);
+            double median = results.add(
+                device, {"occupancy", name, "waves=" + to_string(waves),
+                         static_cast<double>(data.size()), "elements",
+                         global_size, wavefront, timings,
+                         verification_status(verified.passed())});
+            if (!check_verification(verified, options))
+                return;
+            global_sizes.push_back(global_size);
+            throughput.push_back(data.size() / median / 1.0E6);
+        }
+        if (throughput.empty())
+            continue;
+
+        double peak = *max_element(throughput.begin(), throughput.end());
+        cout << name << " (" << units << " compute units x " << wavefront
+             << " work-item wavefront)" << endl;
+        cout << setw(12) << "Global" << setw(12) << "M/s" << endl;
+        for (unsigned i = 0; i < global_sizes.size(); ++i) {
+            cout << setw(12) << global_sizes[i] << setw(12) << throughput[i]
+                 << " " << ascii_bar(throughput[i], peak) << endl;
+        }
+        for (unsigned i = 0; i < global_sizes.size(); ++i) {
+            if (throughput[i] >= 0.9 * peak) {
+                cout << name << ": 90% of peak at " << global_sizes[i]
+                     << " work-items" << endl;
+                break;
+            }
+        }
+    }
+}
+
+// Power of two size with a binary postfix, e.g. 4K or 16M.
+string format_size(size_t bytes)
+{
+    const char* postfix[] = {"", "K", "M", "G", "T"};
+    unsigned i = 0;
+    while (bytes >= 1024 && bytes % 1024 == 0 && i < 4) {
+        bytes /= 1024;
+        ++i;
+    }
+    return to_string(bytes) + postfix[i];
+}
+
+// Time transfer at every size in the sweep and print its bandwidth and
+// latency, followed by the size at which half of the peak is reached.
+void report_transfer(const cl::Device& device, const string& name,
+                     const vector<size_t>& sizes,
+                     const bench_options& options,
+                     const function<bench_timing(size_t)>& transfer)
+{
+    vector<double> bandwidth;
+    for (auto size : sizes) {
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return transfer(size);
+        });
+        double median = results.add(device, {"transfer", name, "",
+                                             static_cast<double>(size),
+                                             "bytes", 0, 0, timings, ""});
+        sample_stats wall = compute_stats(
+            timing_samples(timings, &bench_timing::wall));
+        bandwidth.push_back(size / median / 1.0E9);
+        cout << setw(15) << left << name << right
+             << setw(10) << format_size(size)
+             << setw(12) << bandwidth.back()
+             << setw(12) << median * 1.0E6
+             << setw(12) << wall.median * 1.0E6 << endl;
+    }
+
+    double peak = *max_element(bandwidth.begin(), bandwidth.end());
+    for (unsigned i = 0; i < sizes.size(); ++i) {
+        if (bandwidth[i] >= peak / 2) {
+            cout << name << ": peak " << peak << " GB/s, half of peak at "
+                 << format_size(sizes[i]) << endl;
+            break;
+        }
+    }
+}
+
+// Measure host to device, device to host and device to device bandwidth
+// over a sweep of transfer sizes up to max_size bytes.
+void run_transfer_ops(cl::Device& device, size_t max_size,
+                      const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    max_size = min<size_t>(max_size,
+                           device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+    vector<size_t> sizes;
+    for (size_t size = 4096; size <= max_size; size *= 4)
+        sizes.push_back(size);
+    if (sizes.empty()) {
+        cerr << "Transfer benchmark needs at least 4K of memory." << endl;
+        return;
+    }
+    max_size = sizes.back();
+
+    cl::Buffer dev_a(context, CL_MEM_READ_WRITE, max_size);
+    cl::Buffer dev_b(context, CL_MEM_READ_WRITE, max_size);
+
+    // Pageable memory is ordinary heap memory the driver has to stage.
+    vector<char> pageable(max_size);
+
+    // Pinned memory is a host allocated buffer kept mapped for its lifetime.
+    cl::Buffer pinned(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                      max_size);
+    void* pinned_ptr = queue.enqueueMapBuffer(pinned, CL_TRUE,
+                                              CL_MAP_READ | CL_MAP_WRITE,
+                                              0, max_size);
+
+    // Zero copy buffers wrap page aligned host memory, so moving data
+    // between host and device is only a map or unmap.
+    void* host_ptr = NULL;
+    if (posix_memalign(&host_ptr, 4096, max_size)) {
+        cerr << "Error allocating zero copy host memory." << endl;
+        exit(1);
+    }
+    unique_ptr<void, void (*)(void*)> host_mem(host_ptr, free);
+    cl::Buffer zero_copy(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+                         max_size, host_ptr);
+
+    cout << setw(15) << left << "Transfer" << right << setw(10) << "Size"
+         << setw(12) << "GB/s" << setw(12) << "Device us"
+         << setw(12) << "Wall us" << endl;
+
+    report_transfer(device, "Pageable H2D", sizes, options, [&](size_t size) {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueWriteBuffer(dev_a, CL_FALSE, 0, size,
+                                     pageable.data(), NULL, event);
+        });
+    });
+    report_transfer(device, "Pageable D2H", sizes, options, [&](size_t size) {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueReadBuffer(dev_a, CL_FALSE, 0, size,
+                                    pageable.data(), NULL, event);
+        });
+    });
+    report_transfer(device, "Pinned H2D", sizes, options, [&](size_t size) {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueWriteBuffer(dev_a, CL_FALSE, 0, size, pinned_ptr,
+                                     NULL, event);
+        });
+    });
+    report_transfer(device, "Pinned D2H", sizes, options, [&](size_t size) {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueReadBuffer(dev_a, CL_FALSE, 0, size, pinned_ptr,
+                                    NULL, event);
+        });
+    });
+    report_transfer(device, "Zero-copy H2D", sizes, options, [&](size_t size) {
+        void* ptr = queue.enqueueMapBuffer(zero_copy, CL_TRUE,
+                                           CL_MAP_WRITE_INVALIDATE_REGION,
+                                           0, size);
+        return time_command([&](cl::Event* event) {
+            queue.enqueueUnmapMemObject(zero_copy, ptr, NULL, event);
+        });
+    });
+    report_transfer(device, "Zero-copy D2H", sizes, options, [&](size_t size) {
+        void* ptr = NULL;
+        bench_timing timing = time_command([&](cl::Event* event) {
+            ptr = queue.enqueueMapBuffer(zero_copy, CL_FALSE, CL_MAP_READ,
+                                         0, size, NULL, event);
+        });
+        queue.enqueueUnmapMemObject(zero_copy, ptr);
+        queue.finish();
+        return timing;
+    });
+    report_transfer(device, "Device D2D", sizes, options, [&](size_t size) {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueCopyBuffer(dev_a, dev_b, 0, 0, size, NULL, event);
+        });
+    });
+
+    queue.enqueueUnmapMemObject(pinned, pinned_ptr);
+    queue.finish();
+}
+
+// Median time of kernel over global_size work-items, in seconds. The
+// trials are recorded for benchmark as work done in unit per launch, with
+// flops per launch if the kernel does arithmetic.
+double time_kernel(cl::CommandQueue& queue, cl::Kernel& kernel,
+                   size_t global_size, size_t local_size,
+                   const bench_options& options, const string& benchmark,
+                   const string& config, double work, const string& unit,
+                   double flops = 0)
+{
+    vector<bench_timing> timings = collect_trials(options, [&]() {
+        return time_command([&](cl::Event* event) {
+            queue.enqueueNDRangeKernel(
+                kernel, cl::NullRange, cl::NDRange(global_size),
+                local_size ? cl::NDRange(local_size) : cl::NullRange,
+                NULL, event);
+        });
+    });
+    return results.add(queue.getInfo<CL_QUEUE_DEVICE>(),
+                       {benchmark, kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(),
+                        config, work, unit, global_size, local_size, timings,
+                        "", flops, unit == "bytes" ? work : 0});
+}
+
+// Chain of links through a working set of size bytes, visiting one
+// element per stride elements in random order and returning to the start.
+vector<cl_uint> make_chase_chain(size_t size, size_t stride)
+{
+    vector<cl_uint> next(size / sizeof(cl_uint), 0);
+    vector<cl_uint> order(max<size_t>(next.size() / stride, 1));
+    iota(order.begin(), order.end(), 0);
+    default_random_engine gen;
+    shuffle(order.begin() + 1, order.end(), gen);
+    for (size_t i = 0; i < order.size(); ++i)
+        next[order[i] * stride] = order[(i + 1) % order.size()] * stride;
+    return next;
+}
+
+// Print load latency per working set and the working sets after which it
+// jumps, which mark the capacity of a cache level.
+void report_latency(const string& name, const vector<size_t>& sizes,
+                    const vector<double>& latency)
+{
+    double peak = *max_element(latency.begin(), latency.end());
+    for (unsigned i = 0; i < sizes.size(); ++i) {
+        cout << setw(15) << left << name << right
+             << setw(10) << format_size(sizes[i])
+             << setw(12) << latency[i] * 1.0E9 << " "
+             << ascii_bar(latency[i], peak) << endl;
+    }
+    bool rising = false;
+    for (unsigned i = 1; i < sizes.size(); ++i) {
+        bool jump = latency[i] > 1.3 * latency[i - 1];
+        if (jump && !rising) {
+            cout << name << ": latency rises past "
+                 << format_size(sizes[i - 1]) << " ("
+                 << latency[i - 1] * 1.0E9 << " ns to "
+                 << latency[i] * 1.0E9 << " ns)" << endl;
+        }
+        rising = jump;
+    }
+}
+
+// Measure STREAM style read, write, copy and triad bandwidth, bandwidth of
+// strided loads, and load latency over working sets from 1K up to the
+// test size in global memory and below the local memory size.
+void run_memory_ops(cl::Device& device, size_t max_size,
+                    const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device,
+                                        read_source(MEMORY_FILE_NAME));
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    // Three arrays share the test size, each within one allocation.
+    size_t bytes = min<size_t>(max_size / 3,
+                               device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>());
+    int size = min<size_t>(bytes / sizeof(float), numeric_limits<int>::max());
+    bytes = size * sizeof(float);
+    size_t global_size = min<size_t>(
+        device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() *
+        device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() * 4, size);
+    cl::Buffer a(context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer b(context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer c(context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer out(context, CL_MEM_WRITE_ONLY, global_size * sizeof(float));
+
+    cout << setw(15) << left << "Pattern" << right << setw(10) << "Stride"
+         << setw(12) << "GB/s" << setw(12) << "Kernel ms" << endl;
+    auto report = [&](const string& name, size_t stride, double moved,
+                      cl::Kernel& kernel, size_t items) {
+        double time = time_kernel(queue, kernel, items, 0, options,
+                                  "memory", "stride=" + to_string(stride),
+                                  moved, "bytes",
+                                  name == "triad" ? 2.0 * size : 0);
+        cout << setw(15) << left << name << right << setw(10) << stride
+             << setw(12) << moved / time / 1.0E9
+             << setw(12) << time * 1.0E3 << endl;
+    };
+
+    cl::Kernel write_op(program, "write_op");
+    write_op.setArg(0, a);
+    write_op.setArg(1, 1.0f);
+    write_op.setArg(2, size);
+    report("write", 1, bytes, write_op, global_size);
+    write_op.setArg(0, b);
+    queue.enqueueNDRangeKernel(write_op, cl::NullRange,
+                               cl::NDRange(global_size));
+
+    cl::Kernel read_op(program, "read_op");
+    read_op.setArg(0, a);
+    read_op.setArg(1, out);
+    read_op.setArg(2, size);
+    report("read", 1, bytes, read_op, global_size);
+
+    cl::Kernel copy_op(program, "copy_op");
+    copy_op.setArg(0, a);
+    copy_op.setArg(1, c);
+    copy_op.setArg(2, size);
+    report("copy", 1, 2.0 * bytes, copy_op, global_size);
+
+    cl::Kernel triad_op(program, "triad_op");
+    triad_op.setArg(0, a);
+    triad_op.setArg(1, b);
+    triad_op.setArg(2, c);
+    triad_op.setArg(3, 3.0f);
+    triad_op.setArg(4, size);
+    report("triad", 1, 3.0 * bytes, triad_op, global_size);
+
+    // Bandwidth of the elements actually used as they spread out.
+    cl::Kernel strided_op(program, "strided_op");
+    strided_op.setArg(0, a);
+    strided_op.setArg(1, out);
+    strided_op.setArg(2, size);
+    for (int stride = 2; stride <= 1024 && stride <= size; stride *= 2) {
+        strided_op.setArg(3, stride);
+        size_t count = size / stride;
+        report("strided read", stride, count * sizeof(float), strided_op,
+               min(global_size, count));
+    }
+
+    // One chain element per cache line, so every step is a new line.
+    size_t line = device.getInfo<CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE>();
+    size_t stride = max<size_t>(line ? line : 64, sizeof(cl_uint)) /
+        sizeof(cl_uint);
+    size_t chase_limit = min<size_t>(
+        {max_size, 1UL << 30, device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()});
+    vector<size_t> sizes;
+    vector<double> latency;
+    cl::Kernel chase_op(program, "chase_op");
+    chase_op.setArg(1, out);
+    chase_op.setArg(2, CHASE_STEPS);
+    for (size_t ws = 1024; ws <= chase_limit; ws *= 2) {
+        vector<cl_uint> next = make_chase_chain(ws, stride);
+        cl::Buffer chain(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         ws, next.data());
+        chase_op.setArg(0, chain);
+        sizes.push_back(ws);
+        latency.push_back(time_kernel(queue, chase_op, 1, 1, options,
+                                      "memory", "set=" + to_string(ws),
+                                      CHASE_STEPS, "loads") / CHASE_STEPS);
+    }
+    cout << setw(15) << left << "Chase" << right << setw(10) << "Set"
+         << setw(12) << "ns" << endl;
+    report_latency("global", sizes, latency);
+
+    // Local memory holds the chain as dense elements.
+    if (device.getInfo<CL_DEVICE_LOCAL_MEM_TYPE>() != CL_LOCAL)
+        cout << "Local memory is emulated in global memory." << endl;
+    size_t local_limit = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    sizes.clear();
+    latency.clear();
+    cl::Kernel local_chase_op(program, "local_chase_op");
+    size_t group_size = min<size_t>(
+        64, local_chase_op.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+    local_chase_op.setArg(1, out);
+    local_chase_op.setArg(4, CHASE_STEPS);
+    for (size_t ws = 1024; ws < local_limit; ws *= 2) {
+        vector<cl_uint> next = make_chase_chain(ws, 1);
+        cl::Buffer chain(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         ws, next.data());
+        local_chase_op.setArg(0, chain);
+        local_chase_op.setArg(2, ws, NULL);
+        local_chase_op.setArg(3, static_cast<int>(next.size()));
+        sizes.push_back(ws);
+        latency.push_back(time_kernel(queue, local_chase_op, group_size,
+                                      group_size, options, "memory",
+                                      "set=" + to_string(ws), CHASE_STEPS,
+                                      "loads") / CHASE_STEPS);
+    }
+    if (!sizes.empty())
+        report_latency("local", sizes, latency);
+}
+
+// Work-group sizes in powers of two up to what the device and kernel
+// allow.
+vector<size_t> power_of_two_work_sizes(cl::Device& device, cl::Kernel& kernel,
+                                       size_t first = 1)
+{
+    size_t limit = min(
+        kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+        device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    vector<size_t> sizes;
+    for (size_t size = first; size <= limit; size *= 2)
+        sizes.push_back(size);
+    return sizes;
+}
+
+// -cl-std option under which device has work_group_reduce_add: CL2.0 for
+// OpenCL C 2.x, CL3.0 for OpenCL C 3.0 with the work-group collective
+// functions feature, or empty if it has neither.
+string work_group_collectives_std(cl::Device& device)
+{
+    if (device.getInfo<CL_DEVICE_OPENCL_C_VERSION>().find("OpenCL C 2.") !=
+        string::npos)
+        return "-cl-std=CL2.0";
+#ifdef CL_VERSION_3_0
+    // Devices before OpenCL 3.0 fail the query.
+    size_t size = 0;
+    if (clGetDeviceInfo(device(), CL_DEVICE_OPENCL_C_FEATURES, 0, NULL,
+                        &size) != CL_SUCCESS)
+        return "";
+    vector<cl_name_version> features(size / sizeof(cl_name_version));
+    clGetDeviceInfo(device(), CL_DEVICE_OPENCL_C_FEATURES, size,
+                    features.data(), NULL);
+    for (auto& feature : features)
+        if (string(feature.name) ==
+            "__opencl_c_work_group_collective_functions")
+            return "-cl-std=CL3.0";
+#endif
+    return "";
+}
+
+// Measure local memory read bandwidth under increasing bank conflicts,
+// the cost of a work-group barrier per work-group size, and a reduction
+// written as a local memory tree against work_group_reduce_add.
+void run_local_ops(cl::Device& device, size_t max_size,
+                   const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    string code = read_source(LOCAL_FILE_NAME);
+    cl::Program program = build_program(context, device, code);
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    size_t local_mem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    if (device.getInfo<CL_DEVICE_LOCAL_MEM_TYPE>() != CL_LOCAL)
+        cout << "Local memory is emulated in global memory." << endl;
+
+    // Largest power of two work-group whose tile fits local memory.
+    cl::Kernel local_read_op(program, "local_read_op");
+    vector<size_t> group_sizes = power_of_two_work_sizes(device,
+                                                         local_read_op);
+    size_t group_size = min<size_t>(group_sizes.back(), 256);
+    size_t tile = 1;
+    while (tile * 2 * sizeof(float) <= local_mem && tile < group_size * 32)
+        tile *= 2;
+    size_t global_size = units * group_size * 4;
+    cl::Buffer out(context, CL_MEM_WRITE_ONLY, global_size * sizeof(float));
+
+    cout << "Local memory reads, work-group " << group_size << endl;
+    cout << setw(15) << left << "Stride" << right << setw(12) << "GB/s"
+         << setw(12) << "Kernel ms" << endl;
+    local_read_op.setArg(0, out);
+    local_read_op.setArg(1, tile * sizeof(float), NULL);
+    local_read_op.setArg(2, static_cast<int>(tile - 1));
+    local_read_op.setArg(4, LOCAL_REPEAT);
+    for (int stride = 1; stride <= 32; stride *= 2) {
+        local_read_op.setArg(3, stride);
+        double moved = global_size * LOCAL_REPEAT * sizeof(float);
+        double time = time_kernel(queue, local_read_op, global_size,
+                                  group_size, options, "local",
+                                  "stride=" + to_string(stride), moved,
+                                  "bytes");
+        cout << setw(15) << left << stride << right
+             << setw(12) << moved / time / 1.0E9
+             << setw(12) << time * 1.0E3 << endl;
+    }
+
+    // One work-group per compute unit, so groups do not queue up.
+    cl::Kernel barrier_op(program, "barrier_op");
+    cout << "Barriers, one work-group per compute unit" << endl;
+    cout << setw(15) << left << "Work-group" << right
+         << setw(12) << "ns" << endl;
+    for (auto size : power_of_two_work_sizes(device, barrier_op)) {
+        if (size * sizeof(float) > local_mem)
+            break;
+        cl::Buffer barrier_out(context, CL_MEM_WRITE_ONLY,
+                               units * size * sizeof(float));
+        barrier_op.setArg(0, barrier_out);
+        barrier_op.setArg(1, size * sizeof(float), NULL);
+        barrier_op.setArg(2, LOCAL_REPEAT);
+        double time = time_kernel(queue, barrier_op, units * size, size,
+                                  options, "local", "", 2.0 * LOCAL_REPEAT,
+                                  "barriers");
+        cout << setw(15) << left << size << right
+             << setw(12) << time / (2.0 * LOCAL_REPEAT) * 1.0E9 << endl;
+    }
+
+    // Reduce a buffer of ones, so every result can be checked exactly.
+    int size = min<size_t>({max_size, 256UL << 20,
+                            device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()}) /
+        sizeof(float);
+    vector<float> ones(size, 1.0f);
+    cl::Buffer input(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                     size * sizeof(float), ones.data());
+
+    cl::Program builtin_program;
+    string collectives_std = work_group_collectives_std(device);
+    bool has_builtin = !collectives_std.empty() &&
+        try_build_program(context, device, code,
+                          collectives_std + " -DUSE_WORK_GROUP_REDUCE",
+                          builtin_program);
+    cl::Kernel reduce_tree_op(program, "reduce_tree_op");
+    cl::Kernel reduce_builtin_op;
+    if (has_builtin)
+        reduce_builtin_op = cl::Kernel(builtin_program, "reduce_builtin_op");
+
+    cout << "Reduction of " << size << " floats" << endl;
+    cout << setw(15) << left << "Work-group" << right
+         << setw(12) << "Tree GB/s" << setw(14) << "Builtin GB/s" << endl;
+    for (auto group : power_of_two_work_sizes(device, reduce_tree_op)) {
+        if (group * sizeof(float) > local_mem)
+            break;
+        size_t groups = units * 4;
+        cl::Buffer partial(context, CL_MEM_WRITE_ONLY,
+                           groups * sizeof(float));
+        auto run = [&](cl::Kernel& kernel) {
+            double time = time_kernel(queue, kernel, groups * group, group,
+                                      options, "local", "",
+                                      size * sizeof(float), "bytes");
+            vector<float> sums(groups);
+            queue.enqueueReadBuffer(partial, CL_TRUE, 0,
+                                    groups * sizeof(float), sums.data());
+            if (accumulate(sums.begin(), sums.end(), 0.0) != size)
+                cerr << "Invalid reduction from device." << endl;
+            return size * sizeof(float) / time / 1.0E9;
+        };
+
+        reduce_tree_op.setArg(0, input);
+        reduce_tree_op.setArg(1, partial);
+        reduce_tree_op.setArg(2, group * sizeof(float), NULL);
+        reduce_tree_op.setArg(3, size);
+        cout << setw(15) << left << group << right
+             << setw(12) << run(reduce_tree_op);
+        if (has_builtin) {
+            reduce_builtin_op.setArg(0, input);
+            reduce_builtin_op.setArg(1, partial);
+            reduce_builtin_op.setArg(2, size);
+            cout << setw(14) << run(reduce_builtin_op);
+        } else {
+            cout << setw(14) << "-";
+        }
+        cout << endl;
+    }
+}
+
+// True when device lists the given OpenCL extension.
+bool has_extension(cl::Device& device, const string& extension)
+{
+    return extension.empty() || device.getInfo<CL_DEVICE_EXTENSIONS>()
+        .find(extension) != string::npos;
+}
+
+// Estimated multiply-add lanes per compute unit, or 0 if unknown. OpenCL
+// does not report this, so GPUs use the usual float figure for their
+// vendor and CPUs the native vector width of each core. GPU rates for
+// other types range from 1:64 to 2:1 of float between parts of the same
+// vendor, so they are left unknown.
+unsigned lanes_per_compute_unit(cl::Device& device, const element_type& type)
+{
+    if (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_GPU) {
+        if (type.name != "float")
+            return 0;
+        string vendor = device.getInfo<CL_DEVICE_VENDOR>();
+        if (vendor.find("NVIDIA") != string::npos)
+            return 128;
+        if (vendor.find("AMD") != string::npos ||
+            vendor.find("Advanced Micro Devices") != string::npos)
+            return 64;
+        return 8;
+    }
+    cl_uint width;
+    if (type.name == "double")
+        width = device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE>();
+    else if (type.name == "half")
+        width = device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_HALF>();
+    else if (type.integer)
+        width = device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_INT>();
+    else
+        width = device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT>();
+    return max<cl_uint>(width, 1);
+}
+
+// Multiply-adds per work-item of the flops kernels, a multiple of 128.
+unsigned flops_mad_count(const bench_options& options)
+{
+    return max(128u, options.mad_count / 128 * 128);
+}
+
+// Measure multiply-add throughput of dependent and independent chains for
+// each data type the device supports, next to the theoretical peak of one
+// multiply-add per lane per clock.
+void run_flops_ops(cl::Device& device, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    string code = read_source(FLOPS_FILE_NAME);
+
+    unsigned mad_count = flops_mad_count(options);
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    double clock = device.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>() * 1.0E6;
+    size_t global_size = units *
+        device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() * 8;
+
+    cout << mad_count << " multiply-adds per work-item, "
+         << global_size << " work-items" << endl;
+    cout << setw(15) << left << "Type" << setw(15) << "Chain" << right
+         << setw(12) << "Measured" << setw(12) << "Peak"
+         << setw(8) << "%" << endl;
+
+    map<string, double> independent;
+    for (auto& type : ELEMENT_TYPES) {
+        if (!has_extension(device, type.extension)) {
+            cout << setw(15) << left << type.name << "not supported" << right
+                 << endl;
+            continue;
+        }
+        cl::Program program = build_program(
+            context, device, code, type.build_options + " -DMAD_COUNT=" +
+            to_string(mad_count));
+        cl::Buffer out(context, CL_MEM_WRITE_ONLY, type.size * global_size);
+        string unit = type.integer ? " GIOPS" : " GFLOPS";
+        double peak = 2.0 * units * clock *
+            lanes_per_compute_unit(device, type) / 1.0E9;
+
+        for (string chain : {"dependent", "independent"}) {
+            cl::Kernel kernel(program, ("mad_" + chain).c_str());
+            kernel.setArg(0, out);
+            kernel.setArg(1, type.integer ? 3.0f : 0.999f);
+            kernel.setArg(2, type.integer ? 1.0f : 0.001f);
+            vector<bench_timing> timings = collect_trials(options, [&]() {
+                return time_command([&](cl::Event* event) {
+                    queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                               cl::NDRange(global_size),
+                                               cl::NullRange, NULL, event);
+                });
+            });
+            double work = 2.0 * mad_count * global_size;
+            double median = results.add(
+                device, {"flops", "mad_" + chain, type.name, work,
+                         type.integer ? "op" : "flop", global_size, 0,
+                         timings, "", type.integer ? 0 : work,
+                         static_cast<double>(type.size * global_size)});
+            double measured = work / median / 1.0E9;
+            cout << setw(15) << left << type.name << setw(15) << chain
+                 << right << setw(12) << measured;
+            if (peak)
+                cout << setw(12) << peak << setw(8) << measured / peak * 100;
+            else
+                cout << setw(12) << "-" << setw(8) << "-";
+            cout << unit << endl;
+            if (chain == "independent")
+                independent[type.name] = measured;
+        }
+    }
+    if (independent.count("float") && independent.count("double"))
+        cout << "FP64:FP32 multiply-add throughput 1:"
+             << independent["float"] / independent["double"] << endl;
+}
+
+// Run range_op and element_op of vectorops.cl built for T over the test
+// data converted to T and return the element_op rate in elements per
+// second, or 0 if the device does not support T or its results are
+// wrong.
+template<class T>
+double run_type_ops(cl::Device& device, cl::Context& context,
+                    cl::CommandQueue& queue, const string& code,
+                    const host_view& data, const bench_options& options)
+{
+    typedef element_traits<T> traits;
+    const element_type& type = traits::type();
+    if (!has_extension(device, type.extension)) {
+        cout << setw(10) << left << type.name << "not supported"
+             << right << endl;
+        return 0;
+    }
+    cl::Program program = build_program(context, device, code,
+                                        type.build_options);
+    vector<T> input(data.size());
+    size_t chunks = (data.size() + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+    parallel_chunks(chunks, {}, [&](size_t chunk) {
+        size_t end = min(data.size(), (chunk + 1) * DATA_CHUNK_SIZE);
+        for (size_t i = chunk * DATA_CHUNK_SIZE; i < end; ++i)
+            input[i] = traits::encode(data[i]);
+    });
+    vector<T> output(data.size());
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(T) * data.size());
+
+    double rate = 0;
+    for (string name : {"range_op", "element_op"}) {
+        cl::Kernel kernel(program, name.c_str());
+        kernel.setArg(0, buff);
+        vector_op_sizes sizes = vector_op_launch(device, kernel, name,
+                                                 data.size());
+        size_t global_size = sizes.global_size;
+        size_t local_size = sizes.local_size;
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return run_bench_function(queue, kernel, input, buff,
+                                      global_size, local_size);
+        });
+        queue.enqueueReadBuffer(buff, CL_TRUE, 0, sizeof(T) * data.size(),
+                                output.data());
+        verify_result verified = verify_elements(output, input, options);
+        double median = results.add(
+            device, {"types", name, type.name,
+                     static_cast<double>(data.size()), "elements",
+                     global_size, local_size, timings,
+                     verification_status(verified.passed()),
+                     type.integer ? 0.0 : data.size(),
+                     2.0 * sizeof(T) * data.size()});
+        if (!check_verification(verified, options))
+            continue;
+        cout << setw(10) << left << type.name << setw(15) << name
+             << right << setw(12) << data.size() / median / 1.0E6
+             << setw(12) << 2.0 * sizeof(T) * data.size() / median / 1.0E9
+             << setw(12) << verified.worst_ulp << endl;
+        if (name == "element_op")
+            rate = data.size() / median;
+    }
+    return rate;
+}
+
+// Run the vector kernels for every element type and report the FP64:FP32
+// throughput ratio of element_op.
+void run_types_ops(cl::Device& device, const string& code,
+                   const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+
+    cout << setw(10) << left << "Type" << setw(15) << "Kernel" << right
+         << setw(12) << "M/s" << setw(12) << "GB/s"
+         << setw(12) << "Worst ulp" << endl;
+    double fp32 = run_type_ops<cl_float>(device, context, queue, code, data,
+                                         options);
+    double fp64 = run_type_ops<cl_double>(device, context, queue, code,
+                                          data, options);
+    run_type_ops<cl_half>(device, context, queue, code, data, options);
+    run_type_ops<cl_int>(device, context, queue, code, data, options);
+    if (fp32 && fp64)
+        cout << "FP64:FP32 element_op throughput 1:" << fp32 / fp64 << endl;
+}
+
+// Host side steps of one way of sharing the test buffer with the device:
+// bind sets the kernel's buffer argument, upload makes the test data
+// visible to the device, download makes the results visible to the host
+// and result points to them.
+struct zero_copy_path {
+    string name;
+    function<void(cl::Kernel&)> bind;
+    function<void()> upload;
+    function<void()> download;
+    function<const float*()> result;
+};
+
+// Time upload, launch and download of range_op and element_op through
+// path and report end to end throughput. The first path's end to end
+// times are kept in reference, and later paths are compared with them.
+void run_zero_copy_path(cl::Device& device, cl::CommandQueue& queue,
+                        cl::Program& program, const host_view& data,
+                        const bench_options& options,
+                        const zero_copy_path& path,
+                        map<string, double>& reference)
+{
+    for (string name : {"range_op", "element_op"}) {
+        cl::Kernel kernel(program, name.c_str());
+        path.bind(kernel);
+        vector_op_sizes sizes = vector_op_launch(device, kernel, name,
+                                                 data.size());
+        size_t global_size = sizes.global_size;
+        size_t local_size = sizes.local_size;
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            cl::Event event;
+            struct timeval tv1, tv2;
+            gettimeofday(&tv1, NULL);
+            path.upload();
+            queue.enqueueNDRangeKernel(
+                kernel, cl::NullRange, cl::NDRange(global_size),
+                local_size ? cl::NDRange(local_size) : cl::NullRange, NULL,
+                &event);
+            path.download();
+            gettimeofday(&tv2, NULL);
+            return event_timing(event, tv1, tv2);
+        });
+        verify_result verified = verify_block(path.result(), 0, data.size(),
+                                              options);
+        double kernel_time = results.add(
+            device, {"zerocopy", name, path.name,
+                     static_cast<double>(data.size()), "elements",
+                     global_size, local_size, timings,
+                     verification_status(verified.passed())});
+        if (!check_verification(verified, options))
+            continue;
+        double wall = compute_stats(
+            timing_samples(timings, &bench_timing::wall)).median;
+        if (!reference.count(name))
+            reference[name] = wall;
+        cout << setw(15) << left << path.name << setw(15) << name << right
+             << setw(12) << data.size() / wall / 1.0E6
+             << setw(12) << kernel_time * 1.0E3 << setw(12) << wall * 1.0E3
+             << setw(11) << reference[name] / wall << "x" << endl;
+    }
+}
+
+// Compare the copy path of the vector benchmark, writing the test data to
+// a device buffer and reading the results back, with sharing it through a
+// mapped CL_MEM_ALLOC_HOST_PTR buffer and through coarse and fine grain
+// SVM. Times include the transfer or map cost on every trial.
+void run_zero_copy_ops(cl::Device& device, const string& code,
+                       const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    cl_device_svm_capabilities svm = 0;
+#ifdef CL_VERSION_2_0
+    if (device.getInfo<CL_DEVICE_VERSION>().find("OpenCL 1.") ==
+        string::npos)
+        clGetDeviceInfo(device(), CL_DEVICE_SVM_CAPABILITIES, sizeof(svm),
+                        &svm, NULL);
+#endif
+    // SVM pointers are passed with clSetKernelArgSVMPointer, which needs
+    // no OpenCL C 2.0, so the program builds the same on every device.
+    cl::Program program = build_program(context, device, code);
+    size_t bytes = sizeof(float) * data.size();
+    map<string, double> reference;
+
+    cout << setw(15) << left << "Path" << setw(15) << "Kernel" << right
+         << setw(12) << "E2E M/s" << setw(12) << "Kernel ms"
+         << setw(12) << "E2E ms" << setw(12) << "vs copy" << endl;
+    {
+        cl::Buffer buff(context, CL_MEM_READ_WRITE, bytes);
+        host_vector result(data.size());
+        run_zero_copy_path(device, queue, program, data, options, {
+            "copy",
+            [&](cl::Kernel& kernel) { kernel.setArg(0, buff); },
+            [&]() {
+                queue.enqueueWriteBuffer(buff, CL_FALSE, 0, bytes,
+                                         data.data());
+            },
+            [&]() {
+                queue.enqueueReadBuffer(buff, CL_TRUE, 0, bytes,
+                                        result.data());
+            },
+            [&]() { return result.data(); }
+        }, reference);
+    }
+
+    // The results stay mapped until the next upload.
+    {
+        cl::Buffer buff(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                        bytes);
+        void* mapped = NULL;
+        auto unmap = [&]() {
+            if (mapped)
+                queue.enqueueUnmapMemObject(buff, mapped);
+            mapped = NULL;
+        };
+        run_zero_copy_path(device, queue, program, data, options, {
+            "map",
+            [&](cl::Kernel& kernel) { kernel.setArg(0, buff); },
+            [&]() {
+                unmap();
+                void* ptr = queue.enqueueMapBuffer(
+                    buff, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, bytes);
+                memcpy(ptr, data.data(), bytes);
+                queue.enqueueUnmapMemObject(buff, ptr);
+            },
+            [&]() {
+                mapped = queue.enqueueMapBuffer(buff, CL_TRUE, CL_MAP_READ,
+                                                0, bytes);
+            },
+            [&]() { return static_cast<const float*>(mapped); }
+        }, reference);
+        unmap();
+        queue.finish();
+    }
+
+#ifdef CL_VERSION_2_0
+    // Coarse grain SVM needs maps like a buffer; fine grain SVM is shared
+    // as is once the queue has finished.
+    for (bool fine : {false, true}) {
+        string name = fine ? "svm fine" : "svm coarse";
+        if (!(svm & (fine ? CL_DEVICE_SVM_FINE_GRAIN_BUFFER :
+                     CL_DEVICE_SVM_COARSE_GRAIN_BUFFER))) {
+            cout << setw(15) << left << name << "not supported" << right
+                 << endl;
+            continue;
+        }
+        void* ptr = clSVMAlloc(context(), CL_MEM_READ_WRITE |
+                               (fine ? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0),
+                               bytes, 0);
+        if (!ptr) {
+            cout << setw(15) << left << name << "allocation failed"
+                 << right << endl;
+            continue;
+        }
+        bool mapped = false;
+        auto unmap = [&]() {
+            if (mapped)
+                clEnqueueSVMUnmap(queue(), ptr, 0, NULL, NULL);
+            mapped = false;
+        };
+        zero_copy_path path;
+        path.name = name;
+        path.bind = [&](cl::Kernel& kernel) {
+            clSetKernelArgSVMPointer(kernel(), 0, ptr);
+        };
+        path.result = [&]() { return static_cast<const float*>(ptr); };
+        if (fine) {
+            path.upload = [&]() { memcpy(ptr, data.data(), bytes); };
+            path.download = [&]() { queue.finish(); };
+        } else {
+            path.upload = [&]() {
+                unmap();
+                clEnqueueSVMMap(queue(), CL_TRUE,
+                                CL_MAP_WRITE_INVALIDATE_REGION, ptr, bytes,
+                                0, NULL, NULL);
+                memcpy(ptr, data.data(), bytes);
+                clEnqueueSVMUnmap(queue(), ptr, 0, NULL, NULL);
+            };
+            path.download = [&]() {
+                clEnqueueSVMMap(queue(), CL_TRUE, CL_MAP_READ, ptr, bytes,
+                                0, NULL, NULL);
+                mapped = true;
+            };
+        }
+        run_zero_copy_path(device, queue, program, data, options, path,
+                           reference);
+        unmap();
+        queue.finish();
+        clSVMFree(context(), ptr);
+    }
+#else
+    cout << "SVM needs OpenCL 2.0 headers." << endl;
+#endif
+}
+
+// Seconds over which the soak benchmark averages throughput to decide
+// when throttling began, and the drop from peak that counts as throttling.
+const unsigned SOAK_WINDOW = 5;
+const double SOAK_THROTTLE_DROP = 0.05;
+
+// Print peak and steady state throughput of a soak time series, and the
+// first second after the peak from which the moving average stays below
+// the throttling level.
+void report_soak(const vector<double>& rates, const string& unit)
+{
+    if (rates.empty()) {
+        cout << "Soak ended before the first second." << endl;
+        return;
+    }
+    size_t peak_at = max_element(rates.begin(), rates.end()) - rates.begin();
+    double peak = rates[peak_at];
+    size_t tail = max<size_t>(rates.size() / 4, 1);
+    double steady = accumulate(rates.end() - tail, rates.end(), 0.0) / tail;
+    cout << "Peak " << peak / 1.0E6 << "M " << unit << "/s at second "
+         << peak_at + 1 << ", steady state " << steady / 1.0E6 << "M "
+         << unit << "/s over the last " << tail << " s ("
+         << (1 - steady / peak) * 100 << "% below peak)" << endl;
+
+    for (size_t i = peak_at + 1; i + SOAK_WINDOW <= rates.size(); ++i) {
+        double average = accumulate(rates.begin() + i,
+                                    rates.begin() + i + SOAK_WINDOW, 0.0) /
+            SOAK_WINDOW;
+        if (average < peak * (1 - SOAK_THROTTLE_DROP)) {
+            cout << "Throttling began at second " << i + 1 << endl;
+            return;
+        }
+    }
+    cout << "No throttling detected." << endl;
+}
+
+// Launch the soak kernel back to back for the soak duration, keeping one
+// launch queued behind the running one, and print throughput,
+// temperature and clock every second.
+void run_soak_ops(cl::Device& device, const string& code,
+                  const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::CommandQueue queue(context, device);
+    const string& name = options.soak_kernel;
+    bool mad = name.compare(0, 4, "mad_") == 0;
+    unsigned mad_count = flops_mad_count(options);
+    cl::Program program = mad ?
+        build_program(context, device, read_source(FLOPS_FILE_NAME),
+                      "-DTYPE=float -DMAD_COUNT=" + to_string(mad_count)) :
+        build_program(context, device, code);
+    cl_int err = CL_SUCCESS;
+    cl::Kernel kernel(program, name.c_str(), &err);
+    if (err != CL_SUCCESS) {
+        cerr << "No soak kernel " << name << endl;
+        return;
+    }
+
+    size_t units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+    size_t global_size;
+    double work;
+    string unit = "Elements";
+    cl::Buffer buff;
+    if (mad) {
+        global_size = units * device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() *
+            8;
+        work = 2.0 * mad_count * global_size;
+        unit = "FLOP";
+        buff = cl::Buffer(context, CL_MEM_WRITE_ONLY,
+                          sizeof(float) * global_size);
+        kernel.setArg(0, buff);
+        kernel.setArg(1, 0.999f);
+        kernel.setArg(2, 0.001f);
+    } else {
+        buff = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                          sizeof(float) * data.size(),
+                          const_cast<float*>(data.data()));
+        kernel.setArg(0, buff);
+        work = data.size();
+        global_size = data.size();
+        if (name == "range_op" || name == "range_stride_op") {
+            kernel.setArg(1, static_cast<int>(data.size()));
+            global_size = name == "range_op" ? units : units * 256;
+        } else if (name.size() > 10) {
+            global_size /= atoi(name.c_str() + 10);
+        }
+    }
+
+    pair<string, string> files = sensor_files(device);
+    cout << "Soaking " << name << " for " << options.soak_seconds << " s"
+         << endl;
+    cout << setw(8) << "Second" << setw(14) << "M " + unit + "/s"
+         << setw(10) << "Temp C" << setw(10) << "MHz" << endl;
+    auto print_sensor = [](double value) {
+        if (isnan(value))
+            cout << setw(10) << "-";
+        else
+            cout << setw(10) << value;
+    };
+
+    vector<double> rates;
+    vector<bench_timing> seconds;
+    struct timeval start, last, now;
+    gettimeofday(&start, NULL);
+    last = now = start;
+    size_t launches = 0;
+    cl::Event previous;
+    while (elapsed(start, now) < options.soak_seconds) {
+        cl::Event current;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                   cl::NDRange(global_size), cl::NullRange,
+                                   NULL, &current);
+        queue.flush();
+        if (previous()) {
+            previous.wait();
+            ++launches;
+        }
+        previous = current;
+        gettimeofday(&now, NULL);
+        double interval = elapsed(last, now);
+        if (interval >= 1 && launches) {
+            rates.push_back(work * launches / interval);
+            seconds.push_back(host_timing(interval / launches));
+            sensor_reading reading = read_sensors(device, files);
+            cout << setw(8) << rates.size() << setw(14)
+                 << rates.back() / 1.0E6;
+            print_sensor(reading.temperature);
+            print_sensor(reading.clock_mhz);
+            cout << endl;
+            launches = 0;
+            last = now;
+        }
+    }
+    queue.finish();
+
+    if (!seconds.empty())
+        results.add(device, {"soak", name, "", work, mad ? "flop" :
+                             "elements", global_size, 0, seconds, ""});
+    report_soak(rates, unit);
+}
+
+// Issue instances independent element_op instances, each on its own
+// buffer and slice of the test data, and wait for all of them. Mode
+// "serial" uses one in-order queue, "out-of-order" one out-of-order queue
+// with event dependencies and "multi-queue" one in-order queue per
+// instance. With transfers every instance uploads its slice first and
+// downloads it into result after; compute can be turned off to time the
+// transfers alone.
+bench_timing run_instances(const string& mode,
+                           vector<cl::CommandQueue>& queues,
+                           cl::CommandQueue& out_of_order,
+                           vector<cl::Kernel>& kernels,
+                           vector<cl::Buffer>& buffers,
+                           const host_view& data, host_vector& result,
+                           size_t count, unsigned instances, bool compute,
+                           bool transfers)
+{
+    size_t bytes = sizeof(float) * count;
+    struct timeval tv1, tv2;
+    gettimeofday(&tv1, NULL);
+    for (unsigned i = 0; i < instances; ++i) {
+        cl::CommandQueue& queue = mode == "out-of-order" ? out_of_order :
+            mode == "serial" ? queues[0] : queues[i];
+        vector<cl::Event> uploaded(1), computed(1);
+        vector<cl::Event>* after_upload = NULL;
+        vector<cl::Event>* after_compute = NULL;
+        if (transfers) {
+            queue.enqueueWriteBuffer(buffers[i], CL_FALSE, 0, bytes,
+                                     data.data() + i * count, NULL,
+                                     &uploaded[0]);
+            after_upload = after_compute = &uploaded;
+        }
+        if (compute) {
+            queue.enqueueNDRangeKernel(kernels[i], cl::NullRange,
+                                       cl::NDRange(count), cl::NullRange,
+                                       after_upload, &computed[0]);
+            after_compute = &computed;
+        }
+        if (transfers)
+            queue.enqueueReadBuffer(buffers[i], CL_FALSE, 0, bytes,
+                                    result.data() + i * count, after_compute);
+        queue.flush();
+    }
+    if (mode == "multi-queue")
+        for (unsigned i = 0; i < instances; ++i)
+            queues[i].finish();
+    else if (mode == "out-of-order")
+        out_of_order.finish();
+    else
+        queues[0].finish();
+    gettimeofday(&tv2, NULL);
+    return host_timing(elapsed(tv1, tv2));
+}
+
+// Run 1, 2, 4, ... up to the queue instance count of independent
+// element_op instances serially, on one out-of-order queue and on one
+// in-order queue each, with and without transfers, and report how
+// aggregate throughput scales against serial execution and how much of
+// the transfer time is hidden behind compute.
+void run_queue_ops(cl::Device& device, const string& code,
+                   const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    unsigned max_instances = max(1u, options.queue_instances);
+    size_t count = data.size() / max_instances;
+    if (!count) {
+        cerr << "Queues benchmark needs at least one element per instance."
+             << endl;
+        return;
+    }
+    host_vector result(count * max_instances);
+
+    vector<cl::CommandQueue> queues;
+    vector<cl::Buffer> buffers;
+    vector<cl::Kernel> kernels;
+    for (unsigned i = 0; i < max_instances; ++i) {
+        queues.emplace_back(context, device);
+        buffers.emplace_back(context, CL_MEM_READ_WRITE,
+                             sizeof(float) * count);
+        kernels.emplace_back(program, "element_op");
+        kernels.back().setArg(0, buffers.back());
+        queues.back().enqueueWriteBuffer(buffers.back(), CL_TRUE, 0,
+                                         sizeof(float) * count,
+                                         data.data() + i * count);
+    }
+    cl_int err = CL_SUCCESS;
+    cl::CommandQueue out_of_order(context, device,
+                                  CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                                  &err);
+    vector<string> modes{"serial", "multi-queue"};
+    if (err == CL_SUCCESS)
+        modes.insert(modes.begin() + 1, "out-of-order");
+    else
+        cout << "Out-of-order queues not supported." << endl;
+
+    cout << count << " elements per instance" << endl;
+    cout << setw(10) << left << "Instances" << setw(15) << "Mode" << right
+         << setw(12) << "Kernel M/s" << setw(10) << "Speedup"
+         << setw(12) << "E2E M/s" << setw(10) << "Speedup" << endl;
+    double serial_e2e = 0, best_e2e = 0;
+    unsigned most = 1;
+    for (unsigned instances = 1; instances <= max_instances;
+         instances *= 2) {
+        double elements = static_cast<double>(count) * instances;
+        double serial_rate[2] = {0, 0};
+        for (auto& mode : modes) {
+            double rate[2];
+            for (bool transfers : {false, true}) {
+                vector<bench_timing> timings = collect_trials(options,
+                                                              [&]() {
+                    return run_instances(mode, queues, out_of_order, kernels,
+                                         buffers, data, result, count,
+                                         instances, true, transfers);
+                });
+                string status;
+                if (transfers) {
+                    verify_result verified = verify_block(
+                        result.data(), 0, count * instances, options);
+                    status = verification_status(verified.passed());
+                    check_verification(verified, options);
+                }
+                double median = results.add(
+                    device, {"queues", "element_op",
+                             mode + (transfers ? " e2e" : "") + " x" +
+                             to_string(instances), elements, "elements",
+                             count, 0, timings, status});
+                rate[transfers] = elements / median;
+                if (mode == "serial")
+                    serial_rate[transfers] = rate[transfers];
+            }
+            cout << setw(10) << left << instances << setw(15) << mode
+                 << right << setw(12) << rate[0] / 1.0E6
+                 << setw(9) << rate[0] / serial_rate[0] << "x"
+                 << setw(12) << rate[1] / 1.0E6
+                 << setw(9) << rate[1] / serial_rate[1] << "x" << endl;
+            if (instances * 2 > max_instances) {
+                most = instances;
+                if (mode == "serial")
+                    serial_e2e = elements / rate[1];
+                else
+                    best_e2e = max(best_e2e, rate[1]);
+            }
+        }
+    }
+
+    // Serially, uploads, kernels and downloads add up. If the copy engines
+    // run alongside compute, the concurrent time approaches the larger of
+    // transfer and compute time.
+    double elements = static_cast<double>(count) * most;
+    double copy_time = compute_stats(timing_samples(
+        collect_trials(options, [&]() {
+            return run_instances("serial", queues, out_of_order, kernels,
+                                 buffers, data, result, count, most, false,
+                                 true);
+        }), &bench_timing::wall)).median;
+    double compute_time = serial_e2e - copy_time;
+    double best_time = elements / best_e2e;
+    double hidden = (serial_e2e - best_time) /
+        max(min(copy_time, compute_time), 1.0E-9);
+    cout << "Transfers " << copy_time * 1.0E3 << " ms, total serial "
+         << serial_e2e * 1.0E3 << " ms, best concurrent "
+         << best_time * 1.0E3 << " ms: "
+         << min(max(hidden, 0.0), 1.0) * 100
+         << "% of the overlappable time hidden, so copy and compute "
+         << (hidden > 0.5 ? "overlap" : "do not overlap") << endl;
+}
+
+// Push data through element_op in tiles of tile_size elements and collect
+// the output in result. Tiles rotate through depth device buffers, and
+// upload, compute and download use their own queues, so with a depth of
+// two or more the upload of tile i + 1 and the download of tile i - 1
+// overlap the compute of tile i. Returns the end to end time.
+bench_timing run_stream_pipeline(cl::Context& context, cl::Device& device,
+                                 cl::Program& program, const host_view& data,
+                                 host_vector& result, size_t tile_size,
+                                 unsigned depth)
+{
+    cl::CommandQueue upload(context, device);
+    cl::CommandQueue compute(context, device);
+    cl::CommandQueue download(context, device);
+    vector<cl::Buffer> buffers;
+    vector<cl::Kernel> kernels;
+    for (unsigned slot = 0; slot < depth; ++slot) {
+        buffers.emplace_back(context, CL_MEM_READ_WRITE,
+                             sizeof(float) * tile_size);
+        kernels.emplace_back(program, "element_op");
+        kernels.back().setArg(0, buffers.back());
+    }
+
+    // Download of the tile that last used each buffer.
+    vector<cl::Event> released(depth);
+    size_t tiles = (data.size() + tile_size - 1) / tile_size;
+    struct timeval tv1, tv2;
+    gettimeofday(&tv1, NULL);
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        unsigned slot = tile % depth;
+        size_t first = tile * tile_size;
+        size_t count = min(tile_size, data.size() - first);
+        vector<cl::Event> free_slot;
+        if (tile >= depth)
+            free_slot.push_back(released[slot]);
+
+        cl::Event uploaded, computed;
+        upload.enqueueWriteBuffer(buffers[slot], CL_FALSE, 0,
+                                  sizeof(float) * count, data.data() + first,
+                                  free_slot.empty() ? NULL : &free_slot,
+                                  &uploaded);
+        vector<cl::Event> after_upload{uploaded};
+        compute.enqueueNDRangeKernel(kernels[slot], cl::NullRange,
+                                     cl::NDRange(count), cl::NullRange,
+                                     &after_upload, &computed);
+        vector<cl::Event> after_compute{computed};
+        download.enqueueReadBuffer(buffers[slot], CL_FALSE, 0,
+                                   sizeof(float) * count,
+                                   result.data() + first, &after_compute,
+                                   &released[slot]);
+        upload.flush();
+        compute.flush();
+        download.flush();
+    }
+    upload.finish();
+    compute.finish();
+    download.finish();
+    gettimeofday(&tv2, NULL);
+    return host_timing(elapsed(tv1, tv2));
+}
+
+// Measure sustained end to end throughput of element_op over data that
+// may not fit on the device, streaming it in tiles, both strictly in
+// sequence and pipelined.
+void run_stream_ops(cl::Device& device, const string& code,
+                    const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    unsigned depth = max(1u, options.stream_depth);
+
+    // Tiles have to fit in one allocation and all of them on the device.
+    size_t tile_bytes = min<size_t>(
+        {options.tile_size, device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+         device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / (depth + 1)});
+    size_t tile_size = max<size_t>(tile_bytes / sizeof(float), 1);
+    tile_size = min(tile_size, data.size());
+    host_vector result(data.size());
+
+    cout << "Streaming " << data.size() << " elements in tiles of "
+         << tile_size << " elements" << endl;
+    for (unsigned slots : {1u, depth}) {
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            return run_stream_pipeline(context, device, program, data, result,
+                                       tile_size, slots);
+        });
+        verify_result verified = verify_block(result.data(), 0,
+                                              result.size(), options);
+        results.add(device, {"stream", "element_op",
+                             "buffers=" + to_string(slots),
+                             static_cast<double>(data.size()), "elements",
+                             tile_size, 0, timings,
+                             verification_status(verified.passed())});
+        if (!check_verification(verified, options))
+            return;
+        sample_stats stats = compute_stats(
+            timing_samples(timings, &bench_timing::wall));
+        cout << setw(15) << left
+             << (slots == 1 ? "Sequential:" : to_string(slots) + " buffers:")
+             << right << data.size() / stats.median / 1.0E6
+             << "M Elements Per Second end to end, " << stats.median * 1.0E3
+             << " ms" << endl;
+        if (depth == 1)
+            break;
+    }
+}
+
+// Print median and p95 of per launch times in microseconds, and the launch
+// rate they correspond to.
+void print_launch_row(const string& queue_name, const string& method,
+                      const vector<double>& samples)
+{
+    sample_stats stats = compute_stats(samples);
+    cout << setw(15) << left << queue_name << setw(18) << method << right
+         << setw(12) << stats.median * 1.0E6 << setw(12) << stats.p95 * 1.0E6
+         << setw(14) << 1 / stats.median << endl;
+}
+
+// Measure the overhead of launching an empty kernel: round trip latency
+// waiting on the launch event or on clFinish, and the rate of back to back
+// launches, on an in-order and an out-of-order queue.
+void run_launch_ops(cl::Device& device, const string& code,
+                    const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::Kernel kernel(program, "empty_op");
+    cl::NDRange global(1);
+
+    cout << setw(15) << left << "Queue" << setw(18) << "Method" << right
+         << setw(12) << "Median us" << setw(12) << "P95 us"
+         << setw(14) << "Launches/s" << endl;
+
+    for (bool in_order : {true, false}) {
+        string name = in_order ? "in-order" : "out-of-order";
+        cl_int err = CL_SUCCESS;
+        cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE |
+                               (in_order ? 0 :
+                                CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE),
+                               &err);
+        if (err != CL_SUCCESS) {
+            cout << setw(15) << left << name << "not supported" << right
+                 << endl;
+            continue;
+        }
+
+        vector<bench_timing> waits = collect_trials(options, [&]() {
+            return time_command([&](cl::Event* event) {
+                queue.enqueueNDRangeKernel(kernel, cl::NullRange, global,
+                                           cl::NullRange, NULL, event);
+            });
+        });
+        // Records report kernel times, so the round trip is recorded as
+        // host timings of the wall samples and the device time separately.
+        vector<bench_timing> round_trips;
+        for (auto& timing : waits)
+            round_trips.push_back(host_timing(timing.wall));
+        results.add(device, {"launch", "empty_op", name + " event wait", 1,
+                             "launches", 1, 0, round_trips, ""});
+        results.add(device, {"launch", "empty_op",
+                             name + " device execution", 1, "launches", 1, 0,
+                             waits, ""});
+        print_launch_row(name, "event wait",
+                         timing_samples(waits, &bench_timing::wall));
+        print_launch_row(name, "device execution",
+                         timing_samples(waits, &bench_timing::kernel));
+
+        vector<bench_timing> finishes = collect_trials(options, [&]() {
+            struct timeval tv1, tv2;
+            gettimeofday(&tv1, NULL);
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, global);
+            queue.finish();
+            gettimeofday(&tv2, NULL);
+            return host_timing(elapsed(tv1, tv2));
+        });
+        results.add(device, {"launch", "empty_op", name + " clFinish", 1,
+                             "launches", 1, 0, finishes, ""});
+        print_launch_row(name, "clFinish",
+                         timing_samples(finishes, &bench_timing::wall));
+
+        // Per launch time of a batch enqueued without waiting in between.
+        vector<bench_timing> batches = collect_trials(options, [&]() {
+            struct timeval tv1, tv2;
+            gettimeofday(&tv1, NULL);
+            for (unsigned i = 0; i < LAUNCH_BATCH_SIZE; ++i)
+                queue.enqueueNDRangeKernel(kernel, cl::NullRange, global);
+            queue.finish();
+            gettimeofday(&tv2, NULL);
+            return host_timing(elapsed(tv1, tv2) / LAUNCH_BATCH_SIZE);
+        });
+        results.add(device, {"launch", "empty_op", name + " back to back", 1,
+                             "launches", 1, 0, batches, ""});
+        print_launch_row(name, "back to back",
+                         timing_samples(batches, &bench_timing::wall));
+    }
+}
+
+// Blocks threads until all of them have arrived, then releases them at
+// once.
+class start_barrier {
+public:
+    explicit start_barrier(unsigned count) : count(count) {}
+
+    void wait()
+    {
+        unique_lock<mutex> lock(mtx);
+        if (--count == 0)
+            cv.notify_all();
+        else
+            cv.wait(lock, [this]() { return count == 0; });
+    }
+
+private:
+    mutex mtx;
+    condition_variable cv;
+    unsigned count;
+};
+
+// Per device state of the concurrent benchmark, owned by one host thread.
+struct device_worker {
+    cl::Device device;
+    cl::Context context;
+    cl::CommandQueue queue;
+    cl::Program program;
+    cl::Buffer buff;
+    cl::Kernel kernel;
+    size_t local_size;
+    stringstream log;
+};
+
+// Throughput of one device over a series of element_op trials. The end to
+// end rate includes uploading the data before every launch; end is when
+// the last trial finished, before verification.
+struct phase_result {
+    double kernel_rate;
+    double end_to_end_rate;
+    size_t elements;
+    struct timeval end;
+};
+
+void setup_worker(device_worker& worker, const string& code,
+                  const host_view& data)
+{
+    worker.context = cl::Context({worker.device});
+    worker.program = build_program(worker.context, worker.device, code, "",
+                                   worker.log);
+    worker.queue = cl::CommandQueue(worker.context, worker.device,
+                                    CL_QUEUE_PROFILING_ENABLE);
+    worker.buff = cl::Buffer(worker.context, CL_MEM_READ_WRITE,
+                             sizeof(float) * data.size());
+    worker.kernel = cl::Kernel(worker.program, "element_op");
+    worker.kernel.setArg(0, worker.buff);
+    worker.local_size = cached_work_size(worker.device, "element_op",
+                                         data.size(), 0);
+}
+
+// Run warmup launches, wait at start if given, then time the trials and
+// record them under phase.
+phase_result run_worker_phase(device_worker& worker, const host_view& data,
+                              const bench_options& options,
+                              const string& phase,
+                              start_barrier* start = NULL)
+{
+    auto launch = [&]() {
+        return run_bench_function(worker.queue, worker.kernel, data,
+                                  worker.buff, data.size(),
+                                  worker.local_size);
+    };
+    for (unsigned i = 0; i < options.warmup; ++i)
+        launch();
+    if (start)
+        start->wait();
+
+    bench_options measured = options;
+    measured.warmup = 0;
+    struct timeval tv1, tv2;
+    gettimeofday(&tv1, NULL);
+    vector<bench_timing> timings = collect_trials(measured, launch);
+    gettimeofday(&tv2, NULL);
+
+    verify_result verified = verify_bench_result(worker.queue, data,
+                                                 worker.buff, options);
+    double median = results.add(
+        worker.device, {"concurrent", "element_op", phase,
+                        static_cast<double>(data.size()), "elements",
+                        data.size(), worker.local_size, timings,
+                        verification_status(verified.passed())});
+    phase_result result;
+    result.elements = data.size() * timings.size();
+    result.kernel_rate = data.size() / median / 1.0E6;
+    result.end_to_end_rate = result.elements / elapsed(tv1, tv2) / 1.0E6;
+    result.end = tv2;
+    check_verification(verified, options, worker.log);
+    return result;
+}
+
+// Run element_op on every device alone and then on all devices at the
+// same time, each from its own thread, context and queue, and report how
+// much contention for the host and buses costs.
+void run_concurrent_ops(vector<cl::Device>& devices, const string& code,
+                        const host_view& data, const bench_options& options)
+{
+    vector<unique_ptr<device_worker>> workers;
+    for (auto& device : devices) {
+        workers.emplace_back(new device_worker);
+        workers.back()->device = device;
+    }
+
+    vector<thread> threads;
+    for (auto& worker : workers)
+        threads.emplace_back(setup_worker, ref(*worker), cref(code),
+                             cref(data));
+    for (auto& t : threads)
+        t.join();
+    threads.clear();
+
+    vector<phase_result> solo;
+    for (auto& worker : workers)
+        solo.push_back(run_worker_phase(*worker, data, options, "solo"));
+
+    vector<phase_result> together(workers.size());
+    start_barrier start(workers.size() + 1);
+    for (unsigned i = 0; i < workers.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            together[i] = run_worker_phase(*workers[i], data, options,
+                                           "together", &start);
+        });
+    }
+    struct timeval tv1, tv2;
+    start.wait();
+    gettimeofday(&tv1, NULL);
+    for (auto& t : threads)
+        t.join();
+
+    // The aggregate ends with the last trial, not after verification.
+    tv2 = tv1;
+    for (auto& result : together)
+        if (elapsed(tv2, result.end) > 0)
+            tv2 = result.end;
+
+    // Throughput in million elements per second.
+    cout << setw(30) << left << "Device" << right
+         << setw(12) << "Solo" << setw(12) << "Together"
+         << setw(12) << "Solo E2E" << setw(12) << "Tog. E2E"
+         << setw(10) << "Slowdown" << endl;
+    double solo_sum = 0;
+    size_t elements = 0;
+    for (unsigned i = 0; i < workers.size(); ++i) {
+        cout << workers[i]->log.str();
+        cout << setw(30) << left
+             << workers[i]->device.getInfo<CL_DEVICE_NAME>().substr(0, 29)
+             << right << setw(12) << solo[i].kernel_rate
+             << setw(12) << together[i].kernel_rate
+             << setw(12) << solo[i].end_to_end_rate
+             << setw(12) << together[i].end_to_end_rate
+             << setw(9) << (1 - together[i].end_to_end_rate /
+                            solo[i].end_to_end_rate) * 100 << "%" << endl;
+        solo_sum += solo[i].end_to_end_rate;
+        elements += together[i].elements;
+    }
+    double aggregate = elements / elapsed(tv1, tv2) / 1.0E6;
+    cout << "Aggregate: " << aggregate << "M Elements Per Second end to end, "
+         << solo_sum << "M if devices scaled perfectly ("
+         << (1 - aggregate / solo_sum) * 100 << "% contention loss)" << endl;
+}
+
+// Kernel placed on a roofline: flops per byte, achieved and attainable
+// GFLOPS under the roof of its precision.
+struct roofline_point {
+    string label;
+    string precision;
+    double intensity;
+    double gflops;
+    double attainable;
+};
+
+// Measured roofs of a device: peak bandwidth from the memory benchmark
+// and peak GFLOPS per precision from the flops benchmark, with the
+// kernels of every other benchmark that know their flops and bytes.
+struct roofline {
+    double bandwidth;
+    map<string, double> peaks;
+    vector<roofline_point> points;
+
+    double ridge(const string& precision) const
+    {
+        return peaks.at(precision) / bandwidth;
+    }
+};
+
+roofline build_roofline(const vector<bench_record>& records)
+{
+    roofline roof;
+    roof.bandwidth = 0;
+    for (auto& record : records) {
+        double rate = record.work / compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel)).median;
+        if (record.benchmark == "memory" && record.unit == "bytes")
+            roof.bandwidth = max(roof.bandwidth, rate / 1.0E9);
+        if (record.benchmark == "flops" && record.unit == "flop")
+            roof.peaks[record.config] = max(roof.peaks[record.config],
+                                            rate / 1.0E9);
+    }
+    for (auto& record : records) {
+        if (!(record.flops > 0 && record.bytes > 0))
+            continue;
+        // Only the types and flops benchmarks run other than float.
+        string precision = record.benchmark == "types" ||
+            record.benchmark == "flops" ? record.config : "float";
+        if (!roof.peaks.count(precision))
+            continue;
+        double time = compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel)).median;
+        roofline_point point;
+        point.label = record.benchmark + " " + record.kernel;
+        if (!record.config.empty())
+            point.label += " " + record.config;
+        point.precision = precision;
+        point.intensity = record.flops / record.bytes;
+        point.gflops = record.flops / time / 1.0E9;
+        point.attainable = min(roof.peaks[precision],
+                               roof.bandwidth * point.intensity);
+        roof.points.push_back(point);
+    }
+    return roof;
+}
+
+// Plot area of the ASCII and SVG rooflines, in flops per byte and GFLOPS,
+// spanning the ridge points and every kernel.
+void roofline_range(const roofline& roof, double& x_min, double& x_max,
+                    double& y_min, double& y_max)
+{
+    x_min = numeric_limits<double>::max();
+    x_max = 0;
+    y_min = numeric_limits<double>::max();
+    y_max = 0;
+    for (auto& peak : roof.peaks) {
+        x_min = min(x_min, roof.ridge(peak.first) / 16);
+        x_max = max(x_max, roof.ridge(peak.first) * 16);
+        y_min = min(y_min, roof.bandwidth * x_min);
+        y_max = max(y_max, peak.second * 2);
+    }
+    for (auto& point : roof.points) {
+        x_min = min(x_min, point.intensity / 2);
+        x_max = max(x_max, point.intensity * 2);
+        y_min = min(y_min, point.gflops / 2);
+    }
+}
+
+// Log-log plot of the float roof, or the first measured one, with the
+// kernels marked by letter.
+void print_roofline(const roofline& roof)
+{
+    const int width = 64, height = 20;
+    double x_min, x_max, y_min, y_max;
+    roofline_range(roof, x_min, x_max, y_min, y_max);
+    auto column = [&](double x) {
+        return static_cast<int>(lround(log(x / x_min) / log(x_max / x_min) *
+                                       (width - 1)));
+    };
+    auto row = [&](double y) {
+        return height - 1 - static_cast<int>(lround(
+            log(y / y_min) / log(y_max / y_min) * (height - 1)));
+    };
+
+    string precision = roof.peaks.count("float") ? "float" :
+        roof.peaks.begin()->first;
+    double peak = roof.peaks.at(precision);
+    vector<string> grid(height, string(width, ' '));
+    for (int c = 0; c < width; ++c) {
+        double x = x_min * pow(x_max / x_min, c / (width - 1.0));
+        int r = row(min(peak, roof.bandwidth * x));
+        if (r >= 0 && r < height)
+            grid[r][c] = x < roof.ridge(precision) ? '/' : '-';
+    }
+    for (unsigned i = 0; i < roof.points.size(); ++i) {
+        int r = row(roof.points[i].gflops);
+        int c = column(roof.points[i].intensity);
+        if (r >= 0 && r < height && c >= 0 && c < width)
+            grid[r][c] = i < 26 ? 'A' + i : '*';
+    }
+
+    cout << "GFLOPS (" << precision << " roof)" << endl;
+    for (int r = 0; r < height; ++r) {
+        cout << setw(10);
+        if (r == 0)
+            cout << y_max;
+        else if (r == height - 1)
+            cout << y_min;
+        else
+            cout << "";
+        cout << " |" << grid[r] << endl;
+    }
+    cout << setw(10) << "" << " +" << string(width, '-') << endl;
+    cout << setw(12) << "" << setw(10) << left << x_min << right
+         << setw(width - 10) << x_max << "  flop/byte" << endl;
+}
+
+// Precision, arithmetic intensity, achieved and attainable GFLOPS and
+// limiting roof of every kernel, with the measured roofs.
+void write_roofline_json(const device_info& device, const roofline& roof,
+                         ostream& out)
+{
+    out << "{\n  \"device\": " << json_string(device.name)
+        << ",\n  \"peak_bandwidth_gbs\": " << roof.bandwidth
+        << ",\n  \"roofs\": [";
+    const char* separator = "\n";
+    for (auto& peak : roof.peaks) {
+        out << separator << "    {\"precision\": " << json_string(peak.first)
+            << ", \"peak_gflops\": " << peak.second
+            << ", \"ridge_flop_per_byte\": " << roof.ridge(peak.first)
+            << "}";
+        separator = ",\n";
+    }
+    out << "\n  ],\n  \"kernels\": [";
+    separator = "\n";
+    for (auto& point : roof.points) {
+        out << separator << "    {\"kernel\": " << json_string(point.label)
+            << ", \"precision\": " << json_string(point.precision)
+            << ", \"flop_per_byte\": " << point.intensity
+            << ", \"gflops\": " << point.gflops
+            << ", \"attainable_gflops\": " << point.attainable
+            << ", \"percent_of_bound\": "
+            << point.gflops / point.attainable * 100
+            << ", \"bound\": " << json_string(
+                point.intensity < roof.ridge(point.precision) ?
+                "memory" : "compute") << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}" << endl;
+}
+
+// Text with the characters XML reserves escaped.
+string xml_text(const string& text)
+{
+    string escaped;
+    for (char c : text) {
+        if (c == '&')
+            escaped += "&amp;";
+        else if (c == '<')
+            escaped += "&lt;";
+        else if (c == '>')
+            escaped += "&gt;";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+// Log-log SVG of every roof with the kernels as labelled dots.
+void write_roofline_svg(const device_info& device, const roofline& roof,
+                        ostream& out)
+{
+    const double width = 800, height = 500, margin = 60;
+    double x_min, x_max, y_min, y_max;
+    roofline_range(roof, x_min, x_max, y_min, y_max);
+    auto x_pos = [&](double x) {
+        return margin + log(x / x_min) / log(x_max / x_min) *
+            (width - 2 * margin);
+    };
+    auto y_pos = [&](double y) {
+        return height - margin - log(y / y_min) / log(y_max / y_min) *
+            (height - 2 * margin);
+    };
+
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width
+        << "\" height=\"" << height << "\" font-family=\"sans-serif\" "
+        << "font-size=\"11\">\n"
+        << "<text x=\"" << margin << "\" y=\"20\" font-size=\"14\">"
+        << "Roofline of " << xml_text(device.name) << "</text>\n"
+        << "<rect x=\"" << margin << "\" y=\"" << margin << "\" width=\""
+        << width - 2 * margin << "\" height=\"" << height - 2 * margin
+        << "\" fill=\"none\" stroke=\"black\"/>\n";
+    for (double x = pow(10, floor(log10(x_min))); x <= x_max; x *= 10)
+        if (x >= x_min)
+            out << "<text x=\"" << x_pos(x) << "\" y=\""
+                << height - margin + 15 << "\" text-anchor=\"middle\">" << x
+                << "</text>\n";
+    for (double y = pow(10, floor(log10(y_min))); y <= y_max; y *= 10)
+        if (y >= y_min)
+            out << "<text x=\"" << margin - 5 << "\" y=\"" << y_pos(y)
+                << "\" text-anchor=\"end\">" << y << "</text>\n";
+    out << "<text x=\"" << width / 2 << "\" y=\"" << height - 15
+        << "\" text-anchor=\"middle\">flop/byte</text>\n"
+        << "<text x=\"15\" y=\"" << height / 2 << "\" transform=\"rotate(-90 "
+        << "15 " << height / 2 << ")\" text-anchor=\"middle\">GFLOPS</text>\n";
+
+    for (auto& peak : roof.peaks) {
+        double ridge = roof.ridge(peak.first);
+        out << "<polyline fill=\"none\" stroke=\"steelblue\" points=\""
+            << x_pos(x_min) << "," << y_pos(roof.bandwidth * x_min) << " "
+            << x_pos(ridge) << "," << y_pos(peak.second) << " "
+            << x_pos(x_max) << "," << y_pos(peak.second) << "\"/>\n"
+            << "<text x=\"" << x_pos(x_max) - 5 << "\" y=\""
+            << y_pos(peak.second) - 5 << "\" text-anchor=\"end\">"
+            << peak.first << " " << peak.second << " GFLOPS</text>\n";
+    }
+    for (auto& point : roof.points)
+        out << "<circle cx=\"" << x_pos(point.intensity) << "\" cy=\""
+            << y_pos(point.gflops) << "\" r=\"4\" fill=\"crimson\"><title>"
+            << xml_text(point.label) << ": " << point.gflops << " GFLOPS, "
+            << point.gflops / point.attainable * 100
+            << "% of bound</title></circle>\n";
+    out << "</svg>" << endl;
+}
+
+// Print the roofline of device from the records of this run and, if
+// prefix is set, write it to <prefix><index>.json and <prefix><index>.svg.
+void report_roofline(cl::Device& device, const string& prefix,
+                     unsigned index)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    roofline roof = build_roofline(results.device_records(device()));
+    if (!roof.bandwidth || roof.peaks.empty()) {
+        cout << "Roofline needs the memory and flops benchmarks." << endl;
+        return;
+    }
+    cout << "Peak bandwidth " << roof.bandwidth << " GB/s" << endl;
+    for (auto& peak : roof.peaks)
+        cout << "Peak " << peak.first << " " << peak.second
+             << " GFLOPS, ridge at " << roof.ridge(peak.first)
+             << " flop/byte" << endl;
+    print_roofline(roof);
+
+    cout << setw(4) << "" << setw(36) << left << "Kernel" << right
+         << setw(12) << "flop/byte" << setw(12) << "GFLOPS"
+         << setw(10) << "% bound" << "  Bound" << endl;
+    for (unsigned i = 0; i < roof.points.size(); ++i) {
+        const roofline_point& point = roof.points[i];
+        cout << setw(4) << left << (i < 26 ? string(1, 'A' + i) : "*")
+             << setw(36) << point.label.substr(0, 35) << right
+             << setw(12) << point.intensity << setw(12) << point.gflops
+             << setw(10) << point.gflops / point.attainable * 100
+             << (point.intensity < roof.ridge(point.precision) ?
+                 "  memory" : "  compute") << endl;
+    }
+
+    if (prefix.empty())
+        return;
+    device_info info = describe_device(device);
+    string base = prefix + to_string(index);
+    ofstream json(base + ".json");
+    write_roofline_json(info, roof, json);
+    ofstream svg(base + ".svg");
+    write_roofline_svg(info, roof, svg);
+    if (!json || !svg)
+        cerr << "Error writing " << base << ".json or .svg" << endl;
+    else
+        cout << "Roofline written to " << base << ".json and .svg" << endl;
+}
+
+// Throughput of the vector benchmark's kernels over test sizes from
+// options.sweep_from bytes up to the size of data, each sweep_factor times
+// the last, and the smallest size reaching 90% of the peak. data is
+// uploaded once into one buffer and every step runs on its leading
+// elements, so nothing is reallocated or uploaded between steps. Launches
+// repeat in place on the resident data, so results are not verified.
+void run_sweep_ops(cl::Device& device, const string& code,
+                   const host_view& data, const bench_options& options)
+{
+    cout << device.getInfo<CL_DEVICE_NAME>() << endl;
+    cl::Context context({device});
+    cl::Program program = build_program(context, device, code);
+    cl::CommandQueue queue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    cl::Buffer buff(context, CL_MEM_READ_WRITE, sizeof(float) * data.size());
+    queue.enqueueWriteBuffer(buff, CL_TRUE, 0, sizeof(float) * data.size(),
+                             data.data());
+
+    vector<size_t> counts;
+    for (double size = options.sweep_from;
+         test_elements(size) <= data.size(); size *= options.sweep_factor) {
+        size_t count = max<size_t>(test_elements(size), 16);
+        if (counts.empty() || count != counts.back())
+            counts.push_back(count);
+    }
+
+    for (string name : {"range_op", "element_op"}) {
+        cl::Kernel kernel(program, name.c_str());
+        kernel.setArg(0, buff);
+        vector<double> rates;
+        cout << name << endl;
+        cout << setw(14) << "Bytes" << setw(12) << "M el/s"
+             << setw(12) << "GB/s" << setw(12) << "Median us" << endl;
+        for (size_t count : counts) {
+            vector_op_sizes sizes = vector_op_launch(device, kernel, name,
+                                                     count);
+            size_t global_size = sizes.global_size;
+            size_t local_size = sizes.local_size;
+            cl::NDRange local = local_size ? cl::NDRange(local_size) :
+                cl::NullRange;
+            vector<bench_timing> timings = collect_trials(options, [&]() {
+                return time_command([&](cl::Event* event) {
+                    queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                               cl::NDRange(global_size),
+                                               local, NULL, event);
+                });
+            });
+            double median = results.add(device,
+                {"sweep", name, "", static_cast<double>(count), "elements",
+                 global_size, local_size, timings, "",
+                 static_cast<double>(count), 8.0 * count});
+            rates.push_back(count / median);
+            cout << setw(14) << sizeof(float) * count
+                 << setw(12) << count / median / 1.0E6
+                 << setw(12) << 8.0 * count / median / 1.0E9
+                 << setw(12) << median * 1.0E6 << endl;
+        }
+        if (rates.empty())
+            continue;
+        double peak = *max_element(rates.begin(), rates.end());
+        for (unsigned i = 0; i < rates.size(); ++i) {
+            if (rates[i] >= 0.9 * peak) {
+                cout << "90% of the peak " << peak / 1.0E6
+                     << "M Elements Per Second from "
+                     << sizeof(float) * counts[i] << " bytes" << endl;
+                break;
+            }
+        }
+    }
+}
+
+// Write the trace as Chrome trace event JSON, for chrome://tracing or
+// Perfetto: process 0 holds a lane per host thread, process n one per
+// command queue of the nth device traced.
+void write_trace_json(ostream& out)
+{
+    size_t dropped;
+    vector<trace_span> spans = trace.recorded(dropped);
+    map<cl_device_id, unsigned> pids;
+    map<pair<cl_device_id, size_t>, size_t> queue_lanes;
+
+    out << fixed << setprecision(3);
+    out << "{\"traceEvents\": [\n  {\"name\": \"process_name\", "
+        << "\"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"host\"}}";
+    for (auto& span : spans) {
+        unsigned pid = 0;
+        size_t tid = span.lane;
+        if (span.device) {
+            auto device = pids.find(span.device);
+            if (device == pids.end()) {
+                unsigned next_pid = pids.size() + 1;
+                device = pids.insert({span.device, next_pid}).first;
+                cl::Device info(span.device);
+                out << ",\n  {\"name\": \"process_name\", \"ph\": \"M\", "
+                    << "\"pid\": " << device->second << ", \"args\": "
+                    << "{\"name\": "
+                    << json_string(info.getInfo<CL_DEVICE_NAME>()) << "}}";
+            }
+            pid = device->second;
+            size_t next_lane = queue_lanes.size();
+            tid = queue_lanes.insert({{span.device, span.lane},
+                                      next_lane}).first->second;
+        }
+        out << ",\n  {\"name\": " << json_string(span.name)
+            << ", \"cat\": \"" << (span.device ? "device" : "host")
+            << "\", \"ph\": \"X\", \"ts\": " << span.start * 1.0E6
+            << ", \"dur\": " << span.duration * 1.0E6 << ", \"pid\": " << pid
+            << ", \"tid\": " << tid << "}";
+    }
+    out << "\n], \"otherData\": {\"dropped spans\": " << dropped << "}}"
+        << endl;
+}
+
+// The host as a result log device, named after its CPU model.
+device_info describe_host()
+{
+    device_info info = device_info();
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            info.name = line.substr(line.find(':') + 2);
+            break;
+        }
+    }
+    if (info.name.empty())
+        info.name = "host";
+    info.vendor = "host";
+    info.compute_units = thread::hardware_concurrency();
+    return info;
+}
+
+// Host version of element_op: the square roots of count elements of in,
+// written to out, with the vector instructions every CPU of the build
+// target has.
+void host_sqrt(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE__)
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_loadu_ps(in + i)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(out + i, vsqrtq_f32(vld1q_f32(in + i)));
+#endif
+    for (; i < count; ++i)
+        out[i] = sqrt(in[i]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// host_sqrt with AVX and AVX-512. They are only called on CPUs that have
+// them, so the default build still runs everywhere.
+__attribute__((target("avx")))
+void host_sqrt_avx(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_loadu_ps(in + i)));
+    for (; i < count; ++i)
+        out[i] = sqrt(in[i]);
+}
+
+__attribute__((target("avx512f")))
+void host_sqrt_avx512(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+    // The masked form avoids the undefined source operand of
+    // _mm512_sqrt_ps, which GCC warns about.
+    for (; i + 16 <= count; i += 16) {
+        __m512 x = _mm512_loadu_ps(in + i);
+        _mm512_storeu_ps(out + i, _mm512_mask_sqrt_ps(x, 0xFFFF, x));
+    }
+    for (; i < count; ++i)
+        out[i] = sqrt(in[i]);
+}
+#endif
+
+typedef void (*host_kernel)(const float*, float*, size_t);
+
+// Widest host_sqrt the running CPU supports, with the name of its
+// instruction set in simd.
+host_kernel select_host_sqrt(string& simd)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx512f")) {
+        simd = "AVX-512";
+        return host_sqrt_avx512;
+    }
+    if (__builtin_cpu_supports("avx")) {
+        simd = "AVX";
+        return host_sqrt_avx;
+    }
+#endif
+#if defined(__SSE__)
+    simd = "SSE";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    simd = "NEON";
+#else
+    simd = "scalar";
+#endif
+    return host_sqrt;
+}
+
+// Threads that stay up between calls of run, so that timing a call does
+// not include starting them. Each call spreads chunks over the threads
+// like parallel_chunks and returns once all are done.
+class thread_pool {
+public:
+    explicit thread_pool(unsigned count)
+        : task(NULL), task_chunks(0), generation(0), pending(0),
+          stopping(false)
+    {
+        for (unsigned t = 0; t < count; ++t)
+            threads.emplace_back([this, t, count]() { work(t, count); });
+    }
+
+    ~thread_pool()
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    void run(size_t chunks, const function<void(size_t)>& func)
+    {
+        unique_lock<mutex> lock(mtx);
+        task = &func;
+        task_chunks = chunks;
+        pending = threads.size();
+        ++generation;
+        wake.notify_all();
+        done.wait(lock, [this]() { return pending == 0; });
+    }
+
+private:
+    void work(unsigned t, unsigned count)
+    {
+        size_t seen = 0;
+        unique_lock<mutex> lock(mtx);
+        for (;;) {
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            const function<void(size_t)>& func = *task;
+            size_t chunks = task_chunks;
+            lock.unlock();
+            for (size_t chunk = t; chunk < chunks; chunk += count)
+                func(chunk);
+            lock.lock();
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    vector<thread> threads;
+    mutex mtx;
+    condition_variable wake;
+    condition_variable done;
+    const function<void(size_t)>* task;
+    size_t task_chunks;
+    size_t generation;
+    unsigned pending;
+    bool stopping;
+};
+
+// Time the widest host_sqrt over the test data on one core and on every
+// core, with the statistics and verification of the device benchmarks.
+// Returns the median rate on every core in elements per second, or 0 if
+// that run failed verification.
+double run_host_ops(const host_view& data, const bench_options& options)
+{
+    device_info host = describe_host();
+    host_vector result(data.size());
+    size_t chunks = (data.size() + DATA_CHUNK_SIZE - 1) / DATA_CHUNK_SIZE;
+    unsigned cores = max(1u, thread::hardware_concurrency());
+    double rate = 0;
+    string simd;
+    host_kernel kernel = select_host_sqrt(simd);
+
+    // Start the threads before any trial is timed.
+    thread_pool pool(cores);
+
+    cout << host.name << " (" << simd << ")" << endl;
+    cout << setw(12) << left << "Threads" << right << setw(12) << "M el/s"
+         << setw(12) << "GB/s" << setw(12) << "Median ms" << endl;
+    for (unsigned threads : {1u, cores}) {
+        vector<bench_timing> timings = collect_trials(options, [&]() {
+            struct timeval tv1, tv2;
+            gettimeofday(&tv1, NULL);
+            if (threads == 1) {
+                kernel(data.data(), result.data(), data.size());
+            } else {
+                pool.run(chunks, [&](size_t chunk) {
+                    size_t first = chunk * DATA_CHUNK_SIZE;
+                    kernel(data.data() + first, result.data() + first,
+                           min(DATA_CHUNK_SIZE, data.size() - first));
+                });
+            }
+            gettimeofday(&tv2, NULL);
+            return host_timing(elapsed(tv1, tv2));
+        });
+        verify_result verified = verify_block(result.data(), 0, data.size(),
+                                              options);
+        double median = results.add(host,
+            {"host", "element_op", "threads=" + to_string(threads),
+             static_cast<double>(data.size()), "elements", 0, 0, timings,
+             verification_status(verified.passed()),
+             static_cast<double>(data.size()), 8.0 * data.size()});
+        if (!check_verification(verified, options))
+            continue;
+        cout << setw(12) << left << threads << right
+             << setw(12) << data.size() / median / 1.0E6
+             << setw(12) << 8.0 * data.size() / median / 1.0E9
+             << setw(12) << median * 1.0E3 << endl;
+        if (threads == cores)
+            rate = data.size() / median;
+    }
+    return rate;
+}
+
+// Speedup of the vector benchmark's kernels on device over the host's
+// rate in elements per second.
+void report_host_speedup(cl::Device& device, double host_rate)
+{
+    for (auto& record : results.device_records(device())) {
+        if (record.benchmark != "vector")
+            continue;
+        double median = compute_stats(
+            timing_samples(record.timings, &bench_timing::kernel)).median;
+        cout << device.getInfo<CL_DEVICE_NAME>() << " " << record.kernel
+             << ": " << record.work / median / host_rate
+             << "x the host" << endl;
+    }
+}
+
+// A distributed run: rank 0 serves on port and waits up to timeout
+// seconds for nodes - 1 other ranks, which join it at coordinator
+// ("host:port"). With sync_start on rank 0 every rank waits until the
+// joining is over before benchmarking. Once done, rank 0 waits up to
+// timeout seconds for the other ranks' results. Nodes more than
+// outlier_sigma robust standard deviations below their peers are
+// reported.
+struct cluster_options {
+    string port;
+    string coordinator;
+    unsigned nodes = 0;
+    bool sync_start = false;
+    double timeout = 300;
+    double outlier_sigma = 3;
+};
+
+// Seconds a joining rank keeps retrying until rank 0 is up.
+const unsigned CLUSTER_CONNECT_SECONDS = 60;
+
+string host_name()
+{
+    char name[256] = {};
+    gethostname(name, sizeof(name) - 1);
+    return name;
+}
+
+// Socket listening on port on every interface, or -1.
+int listen_socket(const string& port)
+{
+    addrinfo hints = addrinfo();
+    addrinfo* found;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(NULL, port.c_str(), &hints, &found))
+        return -1;
+    int fd = socket(found->ai_family, found->ai_socktype,
+                    found->ai_protocol);
+    int reuse = 1;
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (fd >= 0 && (bind(fd, found->ai_addr, found->ai_addrlen) ||
+                    listen(fd, SOMAXCONN))) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+// Socket connected to address "host:port", retrying for
+// CLUSTER_CONNECT_SECONDS, or -1.
+int connect_socket(const string& address)
+{
+    size_t colon = address.rfind(':');
+    if (colon == string::npos)
+        return -1;
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+    addrinfo hints = addrinfo();
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    for (unsigned attempt = 0; attempt < CLUSTER_CONNECT_SECONDS;
+         ++attempt) {
+        addrinfo* found;
+        if (!getaddrinfo(host.c_str(), port.c_str(), &hints, &found)) {
+            int fd = socket(found->ai_family, found->ai_socktype,
+                            found->ai_protocol);
+            bool connected = fd >= 0 &&
+                !connect(fd, found->ai_addr, found->ai_addrlen);
+            freeaddrinfo(found);
+            if (connected)
+                return fd;
+            if (fd >= 0)
+                close(fd);
+        }
+        sleep(1);
+    }
+    return -1;
+}
+
+bool send_text(int fd, const string& text)
+{
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = send(fd, text.data() + sent, text.size() - sent, 0);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Host clock reading seconds from now.
+timeval time_after(double seconds)
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    tv.tv_sec += static_cast<time_t>(seconds);
+    return tv;
+}
+
+// Wait until fd is readable. False if deadline, unless NULL, passed first;
+// data already waiting is still read after the deadline.
+bool wait_readable(int fd, const timeval* deadline)
+{
+    int timeout = -1;
+    if (deadline) {
+        timeval now;
+        gettimeofday(&now, NULL);
+        double left = elapsed(now, *deadline);
+        timeout = left > 0 ? static_cast<int>(left * 1000) + 1 : 0;
+    }
+    pollfd entry = {fd, POLLIN, 0};
+    return poll(&entry, 1, timeout) > 0;
+}
+
+// Read up to the next newline, which is dropped.
+bool read_line(int fd, string& line, const timeval* deadline = NULL)
+{
+    line.clear();
+    char c;
+    while (wait_readable(fd, deadline) && recv(fd, &c, 1, 0) == 1) {
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+    return false;
+}
+
+// Read until the peer closes the connection. False if deadline passed
+// first.
+bool read_all(int fd, string& text, const timeval* deadline)
+{
+    text.clear();
+    char buffer[65536];
+    ssize_t n;
+    while (wait_readable(fd, deadline)) {
+        n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return n == 0;
+        text.append(buffer, n);
+    }
+    return false;
+}
+
+// Ranks joined to rank 0, with their host names.
+struct cluster_node {
+    int fd;
+    string name;
+};
+
+// On rank 0, accept the other ranks until all have joined or the timeout
+// passes, and continue with those present. Each rank is told on joining
+// whether to wait for the start, which is sent to all once joining is over.
+// Exits if the port cannot be served.
+vector<cluster_node> serve_cluster(const cluster_options& cluster)
+{
+    int server = listen_socket(cluster.port);
+    if (server < 0) {
+        cerr << "Cannot listen on port " << cluster.port << endl;
+        exit(1);
+    }
+    timeval deadline = time_after(cluster.timeout);
+    vector<cluster_node> nodes;
+    while (nodes.size() + 1 < cluster.nodes &&
+           wait_readable(server, &deadline)) {
+        int fd = accept(server, NULL, NULL);
+        string name;
+        if (fd < 0 || !read_line(fd, name, &deadline) ||
+            !send_text(fd, cluster.sync_start ? "sync\n" : "run\n")) {
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        nodes.push_back({fd, name});
+        cout << "Node " << name << " joined (" << nodes.size() + 1 << " of "
+             << cluster.nodes << ")" << endl;
+    }
+    close(server);
+    if (nodes.size() + 1 < cluster.nodes)
+        cerr << "Only " << nodes.size() + 1 << " of " << cluster.nodes
+             << " ranks joined within " << cluster.timeout
+             << " seconds, continuing with them." << endl;
+    for (auto& node : nodes)
+        send_text(node.fd, "start\n");
+    return nodes;
+}
+
+// On other ranks, join rank 0 and wait for the start if rank 0 asks for a
+// synchronized one. Exits if rank 0 cannot be reached.
+int join_cluster(const cluster_options& cluster)
+{
+    int fd = connect_socket(cluster.coordinator);
+    if (fd < 0 || !send_text(fd, host_name() + "\n")) {
+        cerr << "Cannot join " << cluster.coordinator << endl;
+        exit(1);
+    }
+    string mode, start;
+    if (!read_line(fd, mode) ||
+        (mode == "sync" && (!read_line(fd, start) || start != "start"))) {
+        cerr << "Lost the connection to " << cluster.coordinator << endl;
+        exit(1);
+    }
+    return fd;
+}
+
+// The records of every rank, each row tagged with its node's name. Ranks
+// that have not sent all their results within timeout seconds are left
+// out.
+vector<record_row> gather_cluster(vector<cluster_node>& nodes, double timeout)
+{
+    vector<record_row> rows = results.rows();
+    for (auto& row : rows)
+        row["node"] = host_name();
+    timeval deadline = time_after(timeout);
+    for (auto& node : nodes) {
+        vector<record_row> received;
+        string text;
+        if (!read_all(node.fd, text, &deadline))
+            cerr << "No results from " << node.name << " within " << timeout
+                 << " seconds" << endl;
+        else if (!parse_json_rows(text, received))
+            cerr << "Incomplete results from " << node.name << endl;
+        close(node.fd);
+        for (auto& row : received)
+            row["node"] = node.name;
+        rows.insert(rows.end(), received.begin(), received.end());
+    }
+    return rows;
+}
+
+// Throughput of one device of one node in a fleet configuration.
+struct fleet_entry {
+    string node;
+    string pci_address;
+    string driver;
+    double throughput;
+};
+
+// Per device model and configuration, the median throughput over the
+// fleet, and every device more than sigmas standard deviations below it.
+// Peers are grouped regardless of driver, so a misconfigured one stands
+// out, and outliers are named by node and PCI address where known. The
+// deviation is estimated as 1.4826 times the median absolute
+// deviation, so the outliers themselves do not widen it, or from the mean
+// absolute deviation when most devices agree exactly. Returns the number
+// of outliers.
+unsigned report_fleet(const vector<record_row>& rows, double sigmas)
+{
+    map<string, vector<fleet_entry>> configs;
+    map<string, record_row> firsts;
+    set<string> nodes;
+    for (auto& row : rows) {
+        auto trial = row.find("trial");
+        auto throughput = row.find("throughput_per_s");
+        string key;
+        if (trial == row.end() || trial->second != "0" ||
+            throughput == row.end() || throughput->second.empty() ||
+            !baseline_key(row, key))
+            continue;
+        auto pci = row.find("pci_address");
+        configs[key].push_back({row.at("node"),
+                                pci == row.end() ? "" : pci->second,
+                                row.at("driver_version"),
+                                stod(throughput->second)});
+        firsts.insert({key, row});
+        nodes.insert(row.at("node"));
+    }
+
+    unsigned outliers = 0;
+    cout << "Fleet of " << nodes.size() << " nodes, median throughput"
+         << endl;
+    cout << setw(30) << left << "Device" << setw(40) << "Configuration"
+         << right << setw(8) << "Devices" << setw(14) << "Median"
+         << setw(14) << "Min" << endl;
+    for (auto& entry : configs) {
+        const record_row& row = firsts.at(entry.first);
+        string name = row.at("benchmark") + " " + row.at("kernel");
+        if (!row.at("config").empty())
+            name += " " + row.at("config");
+        vector<double> values;
+        for (auto& device : entry.second)
+            values.push_back(device.throughput);
+        sample_stats stats = compute_stats(values);
+        double median = stats.median;
+        vector<double> deviations;
+        for (double value : values)
+            deviations.push_back(fabs(value - median));
+        sample_stats spread = compute_stats(deviations);
+        double sigma = 1.4826 * spread.median;
+        if (sigma == 0)
+            sigma = 1.2533 * spread.mean;
+        cout << setw(30) << left << row.at("device").substr(0, 29)
+             << setw(40) << name.substr(0, 39) << right
+             << setw(8) << values.size() << setw(14) << median
+             << setw(14) << stats.min
+             << " " << row.at("unit") << "/s" << endl;
+        for (auto& device : entry.second) {
+            if (!(sigma > 0) ||
+                device.throughput >= median - sigmas * sigma)
+                continue;
+            ++outliers;
+            cout << "  OUTLIER " << device.node;
+            if (!device.pci_address.empty())
+                cout << " " << device.pci_address;
+            cout << " (driver "
+                 << device.driver << "): " << device.throughput << ", "
+                 << (1 - device.throughput / median) * 100
+                 << "% below the median, "
+                 << (median - device.throughput) / sigma << " sigma" << endl;
+        }
+    }
+    cout << outliers << " outlier(s)" << endl;
+    return outliers;
+}
+
+int main(int argc, char* argv[])
+{
+    vector<cl::Device> devices;
+    unsigned long memory_test_size = 512E6;
+    double memory_fraction = 0;
+    bool device_index_set = false;
+    unsigned device_index = 0;
+    bench_options options;
+    device_filter filter;
+
+    // Parse command line options before touching any OpenCL driver.
+    bool list_devices_flag = false;
+    bool sweep_set = false;
+    bool trials_set = false;
+    string trace_file;
+    cluster_options cluster;
+    bool benchmarks_set = false;
+    vector<kernel_descriptor> descriptors;
+    int opt;
+    const struct option long_options[] = {
+        {"format", required_argument, NULL, 'F'},
+        {"baseline", required_argument, NULL, 'B'},
+        {"threshold", required_argument, NULL, 'R'},
+        {"duration", required_argument, NULL, 'D'},
+        {"soak-kernel", required_argument, NULL, 'K'},
+        {"instances", required_argument, NULL, 'I'},
+        {"roofline", required_argument, NULL, 'P'},
+        {"sweep", required_argument, NULL, 'S'},
+        {"trace", required_argument, NULL, 'X'},
+        {"serve", required_argument, NULL, 'L'},
+        {"nodes", required_argument, NULL, 'N'},
+        {"join", required_argument, NULL, 'J'},
+        {"sync-start", no_argument, NULL, 'Y'},
+        {"outlier-sigma", required_argument, NULL, 'O'},
+        {"cluster-timeout", required_argument, NULL, 'Q'},
+        {"platform", required_argument, NULL, 'p'},
+        {"type", required_argument, NULL, 't'},
+        {"device-name", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+    while ((opt = getopt_long(argc, argv, ":ls:m:w:n:c:o:v:u:T:d:k:b:p:t:r:h",
+                              long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            if (list_devices_flag)
+                break;
+            list_devices_flag = true;
+            break;
+        case 's':
+            set_memory_test_size(optarg, memory_test_size, memory_fraction);
+            break;
+        case 'm': {
+            benchmarks_set = true;
+            options.benchmarks.clear();
+            stringstream ss(optarg);
+            string name;
+            while (getline(ss, name, ',')) {
+                if (find(BENCHMARK_NAMES.begin(), BENCHMARK_NAMES.end(),
+                         name) == BENCHMARK_NAMES.end()) {
+                    cerr << "Unknown benchmark \"" << name << "\"" << endl;
+                    exit(1);
+                }
+                options.benchmarks.push_back(name);
+            }
+            break;
+        }
+        case 'w':
+            stringstream(optarg) >> options.warmup;
+            break;
+        case 'n':
+            trials_set = true;
+            stringstream(optarg) >> options.trials;
+            if (!options.trials) {
+                cerr << "At least one trial is required." << endl;
+                exit(1);
+            }
+            break;
+        case 'c':
+            stringstream(optarg) >> options.cv_threshold;
+            break;
+        case 'o':
+            stringstream(optarg) >> options.mad_count;
+            break;
+        case 'v':
+            stringstream(optarg) >> options.verify_stride;
+            break;
+        case 'u':
+            stringstream(optarg) >> options.max_ulp;
+            options.max_ulp_set = true;
+            break;
+        case 'T': {
+            double fraction;
+            set_memory_test_size(optarg, options.tile_size, fraction);
+            if (fraction != 0) {
+                cerr << "The tile size must be given in bytes." << endl;
+                exit(1);
+            }
+            break;
+        }
+        case 'd':
+            stringstream(optarg) >> options.stream_depth;
+            break;
+        case 'F':
+            options.format = optarg;
+            if (options.format != "text" && options.format != "json" &&
+                options.format != "csv") {
+                cerr << "Unknown format \"" << optarg << "\"" << endl;
+                exit(1);
+            }
+            break;
+        case 'k':
+            if (!load_kernel_descriptors(optarg, descriptors))
+                exit(1);
+            break;
+        case 'b': {
+            // "|" separates the alternatives of one axis.
+            options.build_axes.emplace_back();
+            string axis = optarg;
+            size_t begin = 0, end;
+            do {
+                end = axis.find('|', begin);
+                options.build_axes.back().push_back(
+                    axis.substr(begin, end - begin));
+                begin = end + 1;
+            } while (end != string::npos);
+            break;
+        }
+        case 'B':
+            options.baseline = optarg;
+            break;
+        case 'R':
+            stringstream(optarg) >> options.regression_threshold;
+            break;
+        case 'D':
+            stringstream(optarg) >> options.soak_seconds;
+            break;
+        case 'K':
+            options.soak_kernel = optarg;
+            break;
+        case 'I':
+            stringstream(optarg) >> options.queue_instances;
+            break;
+        case 'P':
+            options.roofline_prefix = optarg;
+            break;
+        case 'S':
+            set_sweep(optarg, options);
+            sweep_set = true;
+            break;
+        case 'X':
+            trace_file = optarg;
+            trace.enable();
+            break;
+        case 'L':
+            cluster.port = optarg;
+            break;
+        case 'N':
+            stringstream(optarg) >> cluster.nodes;
+            break;
+        case 'J':
+            cluster.coordinator = optarg;
+            break;
+        case 'Y':
+            cluster.sync_start = true;
+            break;
+        case 'O':
+            stringstream(optarg) >> cluster.outlier_sigma;
+            break;
+        case 'Q':
+            stringstream(optarg) >> cluster.timeout;
+            break;
+        case 'p':
+            filter.platform = optarg;
+            break;
+        case 't':
+            if (string(optarg) == "gpu") {
+                filter.type = CL_DEVICE_TYPE_GPU;
+            } else if (string(optarg) == "cpu") {
+                filter.type = CL_DEVICE_TYPE_CPU;
+            } else if (string(optarg) == "accel") {
+                filter.type = CL_DEVICE_TYPE_ACCELERATOR;
+            } else if (string(optarg) == "all") {
+                filter.type = CL_DEVICE_TYPE_ALL;
+            } else {
+                cerr << "Unknown device type \"" << optarg << "\"" << endl;
+                exit(1);
+            }
+            break;
+        case 'r':
+            // std::regex reports a bad pattern only by throwing.
+            try {
+                regex check(optarg);
+            } catch (const regex_error&) {
+                cerr << "Invalid device name pattern \"" << optarg << "\""
+                     << endl;
+                exit(1);
+            }
+            filter.name_pattern = optarg;
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+        default:
+            print_help();
+            exit(1);
+        }
+    }
+
+    // Find the OpenCL devices passing the filters.
+    if (!find_devices(filter, devices)) {
+        cerr << "No platforms found. Verify runtime installation." << endl;
+        exit(1);
+    }
+
+    if (list_devices_flag) {
+        list_devices(devices);
+        exit(0);
+    }
+    if (devices.empty()) {
+        cerr << "No devices match the filters." << endl;
+        exit(1);
+    }
+
+    if (optind < argc) {
+        device_index_set = true;
+        stringstream(argv[optind]) >> device_index;
+        if (device_index >= devices.size()) {
+            cerr << "No device " << device_index << " found." << endl;
+            exit(1);
+        }
+    }
+
+    // Descriptor files select the kernels benchmark unless -m is given.
+    if (!descriptors.empty() && !benchmarks_set)
+        options.benchmarks = {"kernels"};
+
+    // Rerun the benchmarks of the baseline unless others are selected.
+    vector<record_row> baseline;
+    if (!options.baseline.empty()) {
+        if (!read_json_rows(options.baseline, baseline)) {
+            cerr << "Error reading baseline " << options.baseline << endl;
+            exit(1);
+        }
+        if (!benchmarks_set) {
+            options.benchmarks.clear();
+            for (auto& row : baseline) {
+                auto name = row.find("benchmark");
+                if (name != row.end() &&
+                    !benchmark_selected(options, name->second))
+                    options.benchmarks.push_back(name->second);
+            }
+        }
+        // Same trial count, so both sides of the test are equally sized.
+        unsigned baseline_trials = 0;
+        for (auto& row : baseline) {
+            auto trials = row.find("trials");
+            if (trials != row.end() && !trials->second.empty())
+                baseline_trials = max<unsigned>(baseline_trials,
+                                                stoul(trials->second));
+        }
+        if (!trials_set && baseline_trials)
+            options.trials = baseline_trials;
+    }
+
+    // --sweep selects the sweep benchmark.
+    if (sweep_set && !benchmark_selected(options, "sweep"))
+        options.benchmarks.push_back("sweep");
+
+    // The roofline is drawn from the memory and flops results.
+    if (!options.roofline_prefix.empty() &&
+        !benchmark_selected(options, "roofline"))
+        options.benchmarks.push_back("roofline");
+    if (benchmark_selected(options, "roofline")) {
+        for (string name : {"memory", "flops"})
+            if (!benchmark_selected(options, name))
+                options.benchmarks.push_back(name);
+    }
+
+    // The host baseline is compared with the vector benchmark.
+    if (benchmark_selected(options, "host") &&
+        !benchmark_selected(options, "vector"))
+        options.benchmarks.push_back("vector");
+
+    if (!cluster.port.empty() && !cluster.coordinator.empty()) {
+        cerr << "A rank either serves (--serve) or joins (--join)." << endl;
+        exit(1);
+    }
+    if (!cluster.port.empty() && !cluster.nodes) {
+        cerr << "--serve needs the number of ranks (--nodes)." << endl;
+        exit(1);
+    }
+
+    if (benchmark_selected(options, "kernels") && descriptors.empty()) {
+        cerr << "The kernels benchmark needs a descriptor file (-k)." << endl;
+        exit(1);
+    }
+
+    // Machine readable results own stdout; the human readable report moves
+    // to stderr.
+    ostream records_out(cout.rdbuf());
+    if (options.format != "text")
+        cout.rdbuf(cerr.rdbuf());
+
+    vector<cl::Device> selected;
+    if (device_index_set)
+        selected.push_back(devices[device_index]);
+    else
+        selected = devices;
+
+    // Test size of each selected device; stream tiles through several
+    // device buffers and may use more than one allocation. The sweep ends
+    // at its largest size or the largest allocation.
+    vector<unsigned long> sizes, stream_sizes, sweep_sizes;
+    unsigned long largest = 0;
+    for (auto& device : selected) {
+        sizes.push_back(device_test_size(device, memory_test_size,
+                                         memory_fraction));
+        stream_sizes.push_back(device_test_size(device, memory_test_size,
+                                                memory_fraction, true));
+        sweep_sizes.push_back(min<unsigned long>(
+            min(options.sweep_to, MAX_TEST_SIZE),
+            device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()));
+        if (memory_fraction != 0)
+            cout << device.getInfo<CL_DEVICE_NAME>() << ": test size "
+                 << sizes.back() / 1.0E6 << " MB" << endl;
+        largest = max(largest, sizes.back());
+        if (benchmark_selected(options, "stream"))
+            largest = max(largest, stream_sizes.back());
+        if (benchmark_selected(options, "sweep"))
+            largest = max(largest, sweep_sizes.back());
+    }
+
+    // Read the vector kernels and generate the test data only once a
+    // benchmark needs them, once for the largest test size; devices with
+    // smaller sizes use a prefix of it. Generate the data next to the
+    // selected device when its NUMA node is known.
+    string code;
+    auto source = [&]() -> const string& {
+        if (code.empty())
+            code = read_source(CL_FILE_NAME);
+        return code;
+    };
+    host_vector data;
+    auto host_data = [&](unsigned long size) -> host_view {
+        if (data.empty()) {
+            trace_scope scope("generate data");
+            vector<unsigned> cpus;
+            if (device_index_set) {
+                int node = device_numa_node(devices[device_index]);
+                if (node >= 0)
+                    cpus = numa_node_cpus(node);
+            }
+            initialize_data(data, test_elements(largest), 0.0f, 1.0f, cpus);
+        }
+        return host_view(data, test_elements(size));
+    };
+
+    // Join the cluster before benchmarking, so a synchronized start lines
+    // up the ranks.
+    vector<cluster_node> nodes;
+    int coordinator = -1;
+    if (!cluster.port.empty())
+        nodes = serve_cluster(cluster);
+    else if (!cluster.coordinator.empty())
+        coordinator = join_cluster(cluster);
+
+    double host_rate = 0;
+    if (benchmark_selected(options, "host"))
+        host_rate = run_host_ops(
+            host_data(*max_element(sizes.begin(), sizes.end())), options);
+
+    // All devices run the concurrent benchmark over the same data.
+    if (benchmark_selected(options, "concurrent"))
+        run_concurrent_ops(selected, source(),
+                           host_data(*min_element(sizes.begin(), sizes.end())),
+                           options);
+
+    for (unsigned i = 0; i < selected.size(); ++i) {
+        cl::Device& device = selected[i];
+        unsigned long size = sizes[i];
+        // Tune first so a vector run in the same call uses the results.
+        if (benchmark_selected(options, "tune"))
+            run_tune_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "vector"))
+            run_vector_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "kernels"))
+            run_kernel_ops(device, descriptors, host_data(size), options);
+        if (benchmark_selected(options, "transfer"))
+            run_transfer_ops(device, size, options);
+        if (benchmark_selected(options, "flops"))
+            run_flops_ops(device, options);
+        if (benchmark_selected(options, "types"))
+            run_types_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "memory"))
+            run_memory_ops(device, size, options);
+        if (benchmark_selected(options, "local"))
+            run_local_ops(device, size, options);
+        if (benchmark_selected(options, "width"))
+            run_width_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "options"))
+            run_build_option_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "launch"))
+            run_launch_ops(device, source(), options);
+        if (benchmark_selected(options, "zerocopy"))
+            run_zero_copy_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "queues"))
+            run_queue_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "stream"))
+            run_stream_ops(device, source(), host_data(stream_sizes[i]),
+                           options);
+        if (benchmark_selected(options, "occupancy"))
+            run_occupancy_ops(device, source(), host_data(size), options);
+        if (benchmark_selected(options, "sweep"))
+            run_sweep_ops(device, source(), host_data(sweep_sizes[i]),
+                          options);
+        if (benchmark_selected(options, "soak"))
+            run_soak_ops(device, source(), host_data(size), options);
+        // Last, so it includes every kernel run on the device.
+        if (benchmark_selected(options, "roofline"))
+            report_roofline(device, options.roofline_prefix,
+                            device_index_set ? device_index : i);
+    }
+
+    if (host_rate) {
+        cout << "Speedup over the host (" << host_rate / 1.0E6
+             << "M Elements Per Second on every core):" << endl;
+        for (auto& device : selected)
+            report_host_speedup(device, host_rate);
+    }
+
+    if (options.format == "json")
+        results.write_json(records_out);
+    else if (options.format == "csv")
+        results.write_csv(records_out);
+
+    if (!trace_file.empty()) {
+        ofstream file(trace_file);
+        write_trace_json(file);
+        if (!file)
+            cerr << "Error writing trace " << trace_file << endl;
+    }
+
+    // Rank 0 reports the fleet; the other ranks send it their records.
+    unsigned outliers = 0;
+    if (!cluster.port.empty()) {
+        outliers = report_fleet(gather_cluster(nodes, cluster.timeout),
+                                cluster.outlier_sigma);
+    } else if (coordinator >= 0) {
+        stringstream records;
+        results.write_json(records);
+        if (!send_text(coordinator, records.str()))
+            cerr << "Error sending results to " << cluster.coordinator
+                 << endl;
+        close(coordinator);
     }
 
-    return 0;
+    // An empty comparison fails the gate rather than passing it vacuously.
+    unsigned regressions = 0;
+    unsigned matched = 0;
+    if (!options.baseline.empty())
+        regressions = compare_baseline(baseline, results.rows(),
+                                       options.regression_threshold, matched);
+    cout.rdbuf(records_out.rdbuf());
+    return regressions || outliers ||
+        (!options.baseline.empty() && !matched) ? 2 : 0;
 }
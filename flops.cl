@@ -0,0 +1,57 @@
+// Compute bound multiply-add chains, built once per data type with
+// -DTYPE=<type> and -DMAD_COUNT=<n> multiply-adds per work-item. MAD_COUNT
+// must be a multiple of 128. Seeds are kept small so half chains stay finite.
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+#ifdef USE_FP16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+
+#ifdef INTEGER
+// Unsigned so the wrapping multiply-adds stay well defined.
+#define MAD(x, a, b) x = as_int(as_uint(x) * as_uint(a) + as_uint(b))
+#else
+#define MAD(x, a, b) x = mad(x, a, b)
+#endif
+
+#define MAD4(x, a, b) MAD(x, a, b); MAD(x, a, b); MAD(x, a, b); MAD(x, a, b)
+#define MAD16(x, a, b) MAD4(x, a, b); MAD4(x, a, b); \
+                       MAD4(x, a, b); MAD4(x, a, b)
+#define MAD_ALL(a, b) MAD(x0, a, b); MAD(x1, a, b); MAD(x2, a, b); \
+                      MAD(x3, a, b); MAD(x4, a, b); MAD(x5, a, b); \
+                      MAD(x6, a, b); MAD(x7, a, b)
+
+// Every multiply-add depends on the previous one, exposing latency.
+void kernel mad_dependent(global TYPE* out, const float fa, const float fb)
+{
+    const TYPE a = (TYPE)fa;
+    const TYPE b = (TYPE)fb;
+    TYPE x = (TYPE)(get_global_id(0) % 256);
+    for (int i = 0; i < MAD_COUNT / 16; ++i) {
+        MAD16(x, a, b);
+    }
+    out[get_global_id(0)] = x;
+}
+
+// Eight independent chains per work-item, exposing throughput.
+void kernel mad_independent(global TYPE* out, const float fa, const float fb)
+{
+    const TYPE a = (TYPE)fa;
+    const TYPE b = (TYPE)fb;
+    TYPE x0 = (TYPE)(get_global_id(0) % 256);
+    TYPE x1 = x0 + (TYPE)1;
+    TYPE x2 = x0 + (TYPE)2;
+    TYPE x3 = x0 + (TYPE)3;
+    TYPE x4 = x0 + (TYPE)4;
+    TYPE x5 = x0 + (TYPE)5;
+    TYPE x6 = x0 + (TYPE)6;
+    TYPE x7 = x0 + (TYPE)7;
+    for (int i = 0; i < MAD_COUNT / 128; ++i) {
+        MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b);
+        MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b);
+        MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b);
+        MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b); MAD_ALL(a, b);
+    }
+    out[get_global_id(0)] = x0 + x1 + x2 + x3 + x4 + x5 + x6 + x7;
+}
@@ -0,0 +1,76 @@
+// Local memory, barrier and reduction kernels. Work-group sizes must be
+// powers of two.
+
+// Reads local memory repeat times per work-item. Work-item i starts at
+// element i * stride, so a stride of k makes k work-items share a bank.
+void kernel local_read_op(global float* out, local float* tile,
+                          const int mask, const int stride, const int repeat)
+{
+    const int lid = get_local_id(0);
+    for (int i = lid; i <= mask; i += get_local_size(0)) {
+        tile[i] = i;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int index = (lid * stride) & mask;
+    float sum = 0;
+    for (int i = 0; i < repeat; ++i) {
+        sum += tile[index];
+        index = (index + 1) & mask;
+    }
+    out[get_global_id(0)] = sum;
+}
+
+// Exchanges values through local memory with two barriers per round.
+void kernel barrier_op(global float* out, local float* tile, const int repeat)
+{
+    const int lid = get_local_id(0);
+    const int next = (lid + 1) & (get_local_size(0) - 1);
+    float value = lid;
+    for (int i = 0; i < repeat; ++i) {
+        tile[lid] = value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        value += tile[next];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    out[get_global_id(0)] = value;
+}
+
+// Sums A into one partial sum per work-group with a tree in local memory.
+void kernel reduce_tree_op(global const float* A, global float* out,
+                           local float* scratch, const int size)
+{
+    const int lid = get_local_id(0);
+    float sum = 0;
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        sum += A[i];
+    }
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int offset = get_local_size(0) / 2; offset > 0; offset /= 2) {
+        if (lid < offset) {
+            scratch[lid] += scratch[lid + offset];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        out[get_group_id(0)] = scratch[0];
+    }
+}
+
+#ifdef USE_WORK_GROUP_REDUCE
+// reduce_tree_op using the work-group reduction built-in of OpenCL C 2.0,
+// or of OpenCL C 3.0 with __opencl_c_work_group_collective_functions.
+void kernel reduce_builtin_op(global const float* A, global float* out,
+                              const int size)
+{
+    float sum = 0;
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        sum += A[i];
+    }
+    sum = work_group_reduce_add(sum);
+    if (get_local_id(0) == 0) {
+        out[get_group_id(0)] = sum;
+    }
+}
+#endif
@@ -0,0 +1,76 @@
+// Memory access pattern kernels. The streaming kernels use grid-stride
+// loops so any global size covers the whole buffer.
+
+// Loads every element; the per work-item sum keeps the loads alive.
+void kernel read_op(global const float* A, global float* out, const int size)
+{
+    float sum = 0;
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        sum += A[i];
+    }
+    out[get_global_id(0)] = sum;
+}
+
+void kernel write_op(global float* A, const float value, const int size)
+{
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        A[i] = value;
+    }
+}
+
+void kernel copy_op(global const float* A, global float* B, const int size)
+{
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        B[i] = A[i];
+    }
+}
+
+void kernel triad_op(global const float* A, global const float* B,
+                     global float* C, const float scalar, const int size)
+{
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        C[i] = A[i] + scalar * B[i];
+    }
+}
+
+// Loads size / stride elements, stride elements apart.
+void kernel strided_op(global const float* A, global float* out,
+                       const int size, const int stride)
+{
+    float sum = 0;
+    const int count = size / stride;
+    for (int i = get_global_id(0); i < count; i += get_global_size(0)) {
+        sum += A[i * stride];
+    }
+    out[get_global_id(0)] = sum;
+}
+
+// Follows steps links of the chain in next from the first element. Each
+// load depends on the previous one, so time per step is load latency.
+void kernel chase_op(global const uint* next, global uint* out,
+                     const int steps)
+{
+    uint p = 0;
+    for (int i = 0; i < steps; ++i) {
+        p = next[p];
+    }
+    out[0] = p;
+}
+
+// chase_op over a copy of the chain in local memory.
+void kernel local_chase_op(global const uint* next, global uint* out,
+                           local uint* chain, const int count,
+                           const int steps)
+{
+    for (int i = get_local_id(0); i < count; i += get_local_size(0)) {
+        chain[i] = next[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (get_local_id(0) == 0) {
+        uint p = 0;
+        for (int i = 0; i < steps; ++i) {
+            p = chain[p];
+        }
+        out[0] = p;
+    }
+}
@@ -1,17 +1,82 @@
-void kernel range_op(global float* A, const int size)
+// Square root kernels over elements of TYPE, float unless built with
+// -DTYPE=<type>; double needs -DUSE_FP64, half -DUSE_FP16 and int
+// -DINTEGER. Build with -DSQRT=native_sqrt to trade precision for speed.
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+#ifdef USE_FP16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+
+#ifndef TYPE
+#define TYPE float
+#endif
+
+#ifndef SQRT
+#ifdef INTEGER
+// Floor of the square root of x >= 0. The float estimate may be off by one
+// either way, so correct it exactly in integers.
+int isqrt(int x)
+{
+    int r = convert_int_rtz(sqrt(convert_float(x)) + 0.5f);
+    if ((long)r * r > x)
+        --r;
+    else if ((long)(r + 1) * (r + 1) <= x)
+        ++r;
+    return r;
+}
+#define SQRT isqrt
+#else
+#define SQRT sqrt
+#endif
+#endif
+
+void kernel range_op(global TYPE* A, const int size)
 {
     const unsigned range = size / get_global_size(0);
     const unsigned start = get_global_id(0) * range;
-    const unsigned end   = get_global_id(0) == get_global_size(0) ?
+    const unsigned end   = get_global_id(0) == get_global_size(0) - 1 ?
                            size : start + range;
     for (int i = start; i < end; ++i) {
-        A[i] = sqrt(A[i]);
+        A[i] = SQRT(A[i]);
     }
 }
 
-void kernel element_op(global float* A)
+// Grid-stride alternative to range_op: work-items interleave so that
+// neighbouring work-items touch neighbouring elements.
+void kernel range_stride_op(global TYPE* A, const int size)
+{
+    for (int i = get_global_id(0); i < size; i += get_global_size(0)) {
+        A[i] = SQRT(A[i]);
+    }
+}
+
+void kernel element_op(global TYPE* A)
 {
     const unsigned pos = get_global_id(0);
-    A[pos] = sqrt(A[pos]);
+    A[pos] = SQRT(A[pos]);
+}
+
+
+// Does nothing; used to measure launch overhead.
+void kernel empty_op()
+{
+}
+
+// element_op over TYPEN elements, one variant per vector width. Integer
+// builds have no vector square root.
+#define VECTOR(T, N) VECTOR_PASTE(T, N)
+#define VECTOR_PASTE(T, N) T##N
+#define ELEMENT_OP_VEC(N)                            \
+void kernel element_op##N(global VECTOR(TYPE, N)* A) \
+{                                                    \
+    const unsigned pos = get_global_id(0);           \
+    A[pos] = SQRT(A[pos]);                           \
 }
 
+#ifndef INTEGER
+ELEMENT_OP_VEC(2)
+ELEMENT_OP_VEC(4)
+ELEMENT_OP_VEC(8)
+ELEMENT_OP_VEC(16)
+#endif